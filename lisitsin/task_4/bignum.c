@@ -0,0 +1,1179 @@
+#define _DEFAULT_SOURCE
+#include "bignum.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Decimal digits which always fit into a limb
+#define CHUNK_DIGITS 19
+#define CHUNK_BASE 10000000000000000000ULL
+// Shorter operands are multiplied by schoolbook method
+#define KARATSUBA_THRESHOLD 32
+// Longer ones are multiplied by number theoretic transform
+#define NTT_THRESHOLD 2048
+// Numbers of that many limbs are converted chunk by chunk
+#define CONVERSION_THRESHOLD 32
+// Inverses of shorter numbers are found by long division
+#define INVERSE_THRESHOLD 32
+// Halves of longer numbers are converted by different threads
+#define PARALLEL_DIGITS 100000
+// log2(10) / 64 and 64 * log10(2), both rounded up
+#define LIMBS_PER_DIGIT 0.0519051265
+#define DIGITS_PER_LIMB 19.2659197225
+
+typedef unsigned __int128 dlimb_t;
+
+static const uint64_t POWERS_OF_TEN[CHUNK_DIGITS + 1] = {
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL, CHUNK_BASE,
+};
+
+// Arrays below keep the least significant limb first
+
+// powers[k] = 10^(CHUNK_DIGITS * 2^k). Numbers are divided by them
+// as by normalized(shifted so that the highest bit is set) divisors
+// with inverses, which are only found for printing.
+typedef struct {
+	uint64_t* limbs[64];
+	size_t size[64];
+	uint64_t* normalized[64];
+	uint64_t* inverse[64];
+	size_t inverse_size[64];
+	int shift[64];
+	int num;
+} powers_s;
+
+static size_t trim(const uint64_t* a, size_t n)
+{
+	while ((n > 0) && (a[n - 1] == 0))
+		n--;
+	return n;
+}
+
+// r = a + b, returns carry
+static uint64_t add_n(uint64_t* r, const uint64_t* a, const uint64_t* b, size_t n)
+{
+	uint64_t carry = 0;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t sum;
+		uint64_t overflow = __builtin_add_overflow(a[i], b[i], &sum);
+		overflow |= __builtin_add_overflow(sum, carry, &r[i]);
+		carry = overflow;
+	}
+	return carry;
+}
+
+// r += b, returns carry
+static uint64_t add_1(uint64_t* r, size_t n, uint64_t b)
+{
+	for (size_t i = 0; (i < n) && b; i++)
+		b = __builtin_add_overflow(r[i], b, &r[i]);
+	return b;
+}
+
+// r = a - b, returns borrow
+static uint64_t sub_n(uint64_t* r, const uint64_t* a, const uint64_t* b, size_t n)
+{
+	uint64_t borrow = 0;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t diff;
+		uint64_t overflow = __builtin_sub_overflow(a[i], b[i], &diff);
+		overflow |= __builtin_sub_overflow(diff, borrow, &r[i]);
+		borrow = overflow;
+	}
+	return borrow;
+}
+
+// r -= b, returns borrow
+static uint64_t sub_1(uint64_t* r, size_t n, uint64_t b)
+{
+	for (size_t i = 0; (i < n) && b; i++)
+		b = __builtin_sub_overflow(r[i], b, &r[i]);
+	return b;
+}
+
+// Compares a and b as if they were of the same size
+static int compare(const uint64_t* a, size_t an, const uint64_t* b, size_t bn)
+{
+	for (size_t i = (an > bn) ? an : bn; i-- > 0; ) {
+		uint64_t x = (i < an) ? a[i] : 0;
+		uint64_t y = (i < bn) ? b[i] : 0;
+		if (x != y)
+			return (x > y) ? 1 : -1;
+	}
+	return 0;
+}
+
+// r = |a - b| in n >= an, bn limbs, returns 1 if a < b
+static int abs_diff(uint64_t* r, const uint64_t* a, size_t an,
+                    const uint64_t* b, size_t bn, size_t n)
+{
+	int less = compare(a, an, b, bn) < 0;
+	if (less) {
+		const uint64_t* tmp = a;
+		a = b;
+		b = tmp;
+		size_t tmp_size = an;
+		an = bn;
+		bn = tmp_size;
+	}
+	memcpy(r, a, an * sizeof(uint64_t));
+	memset(r + an, 0, (n - an) * sizeof(uint64_t));
+	uint64_t borrow = sub_n(r, r, b, bn);
+	borrow = sub_1(r + bn, n - bn, borrow);
+	assert(!borrow);
+	return less;
+}
+
+// r = r * m + c, returns high limb
+static uint64_t mul_1_add(uint64_t* r, size_t n, uint64_t m, uint64_t c)
+{
+	for (size_t i = 0; i < n; i++) {
+		dlimb_t product = (dlimb_t)r[i] * m + c;
+		r[i] = (uint64_t)product;
+		c = (uint64_t)(product >> 64);
+	}
+	return c;
+}
+
+// r /= d, returns remainder
+static uint64_t div_1(uint64_t* r, size_t n, uint64_t d)
+{
+	uint64_t rem = 0;
+	for (size_t i = n; i-- > 0; ) {
+		dlimb_t cur = ((dlimb_t)rem << 64) | r[i];
+		r[i] = (uint64_t)(cur / d);
+		rem = (uint64_t)(cur % d);
+	}
+	return rem;
+}
+
+// r = a << shift, 0 <= shift < 64, returns bits shifted out
+static uint64_t shift_left(uint64_t* r, const uint64_t* a, size_t n, int shift)
+{
+	if (shift == 0) {
+		memmove(r, a, n * sizeof(uint64_t));
+		return 0;
+	}
+	uint64_t out = 0;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t x = a[i];
+		r[i] = (x << shift) | out;
+		out = x >> (64 - shift);
+	}
+	return out;
+}
+
+// r = a >> shift, 0 <= shift < 64
+static void shift_right(uint64_t* r, const uint64_t* a, size_t n, int shift)
+{
+	if (shift == 0) {
+		memmove(r, a, n * sizeof(uint64_t));
+		return;
+	}
+	for (size_t i = 0; i < n; i++)
+		r[i] = (a[i] >> shift) | ((i + 1 < n) ? a[i + 1] << (64 - shift) : 0);
+}
+
+// r = a * b, r has an + bn limbs and does not overlap operands
+static void mul_basecase(uint64_t* r, const uint64_t* a, size_t an,
+                         const uint64_t* b, size_t bn)
+{
+	memset(r, 0, (an + bn) * sizeof(uint64_t));
+	for (size_t j = 0; j < bn; j++) {
+		uint64_t carry = 0;
+		for (size_t i = 0; i < an; i++) {
+			dlimb_t product = (dlimb_t)a[i] * b[j] + r[i + j] + carry;
+			r[i + j] = (uint64_t)product;
+			carry = (uint64_t)(product >> 64);
+		}
+		r[an + j] = carry;
+	}
+}
+
+// Limbs are coefficients of polynomials multiplied modulo three primes
+// p = c * 2^k + 1 below 2^62 by number theoretic transforms. Coefficients
+// of the product are sums of less than 2^56 products of two limbs, they
+// are below the product of the primes and are recovered from their
+// residues by Chinese remainder theorem.
+#define NTT_PRIMES 3
+static const uint64_t NTT_MODULI[NTT_PRIMES] = {
+	4179340454199820289ULL, 2485986994308513793ULL, 2936346957045563393ULL,
+};
+// Primitive roots of the primes
+static const uint64_t NTT_GENERATORS[NTT_PRIMES] = { 3, 5, 3 };
+
+// Residues are kept in Montgomery form, x * 2^64 mod p
+typedef struct {
+	uint64_t p;
+	// -p^-1 mod 2^64 and 2^128 mod p
+	uint64_t p_inv;
+	uint64_t r2;
+} modulus_s;
+
+static void modulus_init(modulus_s* m, uint64_t p)
+{
+	uint64_t inv = p;
+	// Newton iterations double number of correct bits of p^-1 mod 2^64
+	for (int i = 0; i < 5; i++)
+		inv *= 2 - p * inv;
+	uint64_t r = (uint64_t)(((dlimb_t)1 << 64) % p);
+	m->p = p;
+	m->p_inv = -inv;
+	m->r2 = (uint64_t)((dlimb_t)r * r % p);
+}
+
+// t * 2^-64 mod p for t < p * 2^64
+static inline uint64_t mont_reduce(dlimb_t t, const modulus_s* m)
+{
+	uint64_t q = (uint64_t)t * m->p_inv;
+	uint64_t r = (uint64_t)((t + (dlimb_t)q * m->p) >> 64);
+	return (r >= m->p) ? r - m->p : r;
+}
+
+// a * b * 2^-64 mod p for any a and b < p
+static inline uint64_t mont_mul(uint64_t a, uint64_t b, const modulus_s* m)
+{
+	return mont_reduce((dlimb_t)a * b, m);
+}
+
+static inline uint64_t mod_add(uint64_t a, uint64_t b, uint64_t p)
+{
+	uint64_t r = a + b;
+	return (r >= p) ? r - p : r;
+}
+
+static inline uint64_t mod_sub(uint64_t a, uint64_t b, uint64_t p)
+{
+	return (a >= b) ? a - b : a + p - b;
+}
+
+// b^e for b in Montgomery form
+static uint64_t mont_pow(uint64_t b, uint64_t e, const modulus_s* m)
+{
+	uint64_t r = mont_reduce(m->r2, m);
+	for (; e; e >>= 1, b = mont_mul(b, b, m))
+		if (e & 1)
+			r = mont_mul(r, b, m);
+	return r;
+}
+
+// x^-1 mod p in Montgomery form for plain x
+static uint64_t mont_inverse(uint64_t x, const modulus_s* m)
+{
+	return mont_pow(mont_mul(x, m->r2, m), m->p - 2, m);
+}
+
+// roots[h + j] = w^j for j < h, where w is a root of unity of degree 2h,
+// for all h = 2^i < n. Inverse roots are taken for inverse transform.
+static void ntt_roots(uint64_t* roots, size_t n, uint64_t generator,
+                      const modulus_s* m, int inverse)
+{
+	uint64_t g = mont_mul(generator, m->r2, m);
+	if (inverse)
+		g = mont_pow(g, m->p - 2, m);
+	for (size_t h = 1; h < n; h *= 2) {
+		uint64_t w = mont_pow(g, (m->p - 1) / (2 * h), m);
+		roots[h] = mont_reduce(m->r2, m);
+		for (size_t j = 1; j < h; j++)
+			roots[h + j] = mont_mul(roots[h + j - 1], w, m);
+	}
+}
+
+// Transform of n = 2^k coefficients by decimation in frequency,
+// which leaves them in bit reversed order
+static void ntt_forward(uint64_t* a, size_t n, const uint64_t* roots, const modulus_s* m)
+{
+	// Local copy of the modulus is not reloaded after stores into a
+	const modulus_s mod = *m;
+	for (size_t h = n / 2; h > 0; h /= 2)
+		for (size_t i = 0; i < n; i += 2 * h)
+			for (size_t j = 0; j < h; j++) {
+				uint64_t u = a[i + j], v = a[i + j + h];
+				a[i + j] = mod_add(u, v, mod.p);
+				a[i + j + h] = mont_mul(mod_sub(u, v, mod.p), roots[h + j], &mod);
+			}
+}
+
+// Inverse of ntt_forward() by decimation in time with inverse roots,
+// takes coefficients in bit reversed order and leaves n times them
+static void ntt_inverse(uint64_t* a, size_t n, const uint64_t* roots, const modulus_s* m)
+{
+	const modulus_s mod = *m;
+	for (size_t h = 1; h < n; h *= 2)
+		for (size_t i = 0; i < n; i += 2 * h)
+			for (size_t j = 0; j < h; j++) {
+				uint64_t u = a[i + j], v = mont_mul(a[i + j + h], roots[h + j], &mod);
+				a[i + j] = mod_add(u, v, mod.p);
+				a[i + j + h] = mod_sub(u, v, mod.p);
+			}
+}
+
+// Limbs of a in Montgomery form, padded with zeros to n
+static void ntt_load(uint64_t* t, size_t n, const uint64_t* a, size_t an,
+                     const modulus_s* m)
+{
+	for (size_t i = 0; i < an; i++)
+		t[i] = mont_mul(a[i], m->r2, m);
+	memset(t + an, 0, (n - an) * sizeof(uint64_t));
+}
+
+// r = a * b mod (B^n - 1) by cyclic convolution of n = 2^k >= an, bn
+// limbs, r has n limbs and does not overlap operands
+static void mul_cyclic(uint64_t* r, size_t n, const uint64_t* a, size_t an,
+                       const uint64_t* b, size_t bn)
+{
+	assert((n >= 2) && !(n & (n - 1)) && (an <= n) && (bn <= n));
+	int square = (a == b) && (an == bn);
+	uint64_t* tmp = (uint64_t*)malloc((NTT_PRIMES + 3) * n * sizeof(uint64_t));
+	assert(tmp);
+	uint64_t* residues[NTT_PRIMES];
+	uint64_t* other = tmp + NTT_PRIMES * n;
+	uint64_t* roots = other + n;
+	uint64_t* inverse_roots = roots + n;
+	modulus_s moduli[NTT_PRIMES];
+	for (int k = 0; k < NTT_PRIMES; k++) {
+		const modulus_s* m = &moduli[k];
+		modulus_init(&moduli[k], NTT_MODULI[k]);
+		ntt_roots(roots, n, NTT_GENERATORS[k], m, 0);
+		ntt_roots(inverse_roots, n, NTT_GENERATORS[k], m, 1);
+
+		uint64_t* t = residues[k] = tmp + k * n;
+		ntt_load(t, n, a, an, m);
+		ntt_forward(t, n, roots, m);
+		if (square) {
+			for (size_t i = 0; i < n; i++)
+				t[i] = mont_mul(t[i], t[i], m);
+		} else {
+			ntt_load(other, n, b, bn, m);
+			ntt_forward(other, n, roots, m);
+			for (size_t i = 0; i < n; i++)
+				t[i] = mont_mul(t[i], other[i], m);
+		}
+		ntt_inverse(t, n, inverse_roots, m);
+		// Multiplication by plain n^-1 also leaves Montgomery form
+		uint64_t n_inv = mont_reduce(mont_inverse(n, m), m);
+		for (size_t i = 0; i < n; i++)
+			t[i] = mont_mul(t[i], n_inv, m);
+	}
+
+	// Garner's method: x = x0 + p0 * (t1 + p1 * t2), where
+	// t1 = (x1 - x0) / p0 mod p1, t2 = (x2 - x0 - p0 * t1) / (p0 * p1) mod p2.
+	// Multiplication by c in Montgomery form is plain multiplication by c.
+	const modulus_s* m1 = &moduli[1];
+	const modulus_s* m2 = &moduli[2];
+	uint64_t p0 = moduli[0].p;
+	dlimb_t p01 = (dlimb_t)p0 * m1->p;
+	uint64_t p01_low = (uint64_t)p01, p01_high = (uint64_t)(p01 >> 64);
+	uint64_t inv_p0 = mont_inverse(p0 % m1->p, m1);
+	uint64_t inv_p01 = mont_inverse((uint64_t)(p01 % m2->p), m2);
+	uint64_t p0_inv_p01 = mont_mul(p0 % m2->p, inv_p01, m2);
+	p0_inv_p01 = mont_mul(p0_inv_p01, m2->r2, m2);
+	dlimb_t carry = 0;
+	for (size_t i = 0; i < n; i++) {
+		uint64_t x0 = residues[0][i], x1 = residues[1][i], x2 = residues[2][i];
+		uint64_t t1 = mod_sub(mont_mul(x1, inv_p0, m1), mont_mul(x0, inv_p0, m1), m1->p);
+		uint64_t t2 = mod_sub(mod_sub(mont_mul(x2, inv_p01, m2),
+		                              mont_mul(x0, inv_p01, m2), m2->p),
+		                      mont_mul(t1, p0_inv_p01, m2), m2->p);
+		// carry + x of three limbs, the lowest one is the limb of r
+		dlimb_t low = (dlimb_t)p0 * t1 + x0;
+		dlimb_t middle = (dlimb_t)p01_low * t2;
+		dlimb_t sum = (dlimb_t)(uint64_t)carry + (uint64_t)low + (uint64_t)middle;
+		r[i] = (uint64_t)sum;
+		carry = (carry >> 64) + (low >> 64) + (middle >> 64) + (dlimb_t)p01_high * t2 +
+		        (sum >> 64);
+	}
+	// Carry out of the highest limb wraps around as B^n = 1
+	while (carry)
+		carry = add_1(r, n, (uint64_t)carry) + add_1(r + 1, n - 1, (uint64_t)(carry >> 64));
+	free(tmp);
+}
+
+// r = a * b, r has an + bn limbs and does not overlap operands
+static void mul_ntt(uint64_t* r, const uint64_t* a, size_t an,
+                    const uint64_t* b, size_t bn)
+{
+	size_t n = 2;
+	while (n < an + bn)
+		n *= 2;
+	if (n == an + bn) {
+		mul_cyclic(r, n, a, an, b, bn);
+		return;
+	}
+	uint64_t* product = (uint64_t*)malloc(n * sizeof(uint64_t));
+	assert(product);
+	mul_cyclic(product, n, a, an, b, bn);
+	memcpy(r, product, (an + bn) * sizeof(uint64_t));
+	free(product);
+}
+
+// r = a * b for operands of n limbs by Karatsuba method
+static void mul_n(uint64_t* r, const uint64_t* a, const uint64_t* b, size_t n)
+{
+	if (n < KARATSUBA_THRESHOLD) {
+		mul_basecase(r, a, n, b, n);
+		return;
+	}
+	if (n >= NTT_THRESHOLD) {
+		mul_ntt(r, a, n, b, n);
+		return;
+	}
+	// a = a1 * 2^(64h) + a0, b = b1 * 2^(64h) + b0,
+	// high halves a1 and b1 are of l <= h limbs
+	size_t h = n - n / 2, l = n / 2;
+	uint64_t* tmp = (uint64_t*)malloc((6 * h + 1) * sizeof(uint64_t));
+	assert(tmp);
+	uint64_t* diff_a = tmp;
+	uint64_t* diff_b = tmp + h;
+	uint64_t* product = tmp + 2 * h;
+	uint64_t* middle = tmp + 4 * h;
+
+	// a0 * b0 and a1 * b1 take their places in r
+	mul_n(r, a, b, h);
+	mul_n(r + 2 * h, a + h, b + h, l);
+	// a0 * b1 + a1 * b0 = a0 * b0 + a1 * b1 + (a0 - a1) * (b1 - b0)
+	int negative = abs_diff(diff_a, a, h, a + h, l, h)
+	             ^ abs_diff(diff_b, b + h, l, b, h, h);
+	mul_n(product, diff_a, diff_b, h);
+
+	memcpy(middle, r + 2 * h, 2 * l * sizeof(uint64_t));
+	memset(middle + 2 * l, 0, 2 * (h - l) * sizeof(uint64_t));
+	middle[2 * h] = add_n(middle, middle, r, 2 * h);
+	if (negative)
+		middle[2 * h] -= sub_n(middle, middle, product, 2 * h);
+	else
+		middle[2 * h] += add_n(middle, middle, product, 2 * h);
+
+	uint64_t carry = add_n(r + h, r + h, middle, 2 * h + 1);
+	carry = add_1(r + 3 * h + 1, 2 * n - 3 * h - 1, carry);
+	assert(!carry);
+	free(tmp);
+}
+
+// r = a * b, r has an + bn limbs and does not overlap operands
+static void mul(uint64_t* r, const uint64_t* a, size_t an, const uint64_t* b, size_t bn)
+{
+	if (an < bn) {
+		mul(r, b, bn, a, an);
+		return;
+	}
+	if (bn < KARATSUBA_THRESHOLD) {
+		mul_basecase(r, a, an, b, bn);
+		return;
+	}
+	if (bn >= NTT_THRESHOLD) {
+		mul_ntt(r, a, an, b, bn);
+		return;
+	}
+	if (an == bn) {
+		mul_n(r, a, b, bn);
+		return;
+	}
+
+	// Longer operand is multiplied by pieces of size of the shorter one
+	uint64_t* piece = (uint64_t*)malloc(2 * bn * sizeof(uint64_t));
+	assert(piece);
+	memset(r, 0, (an + bn) * sizeof(uint64_t));
+	for (size_t i = 0; i < an; i += bn) {
+		size_t len = (an - i < bn) ? an - i : bn;
+		mul(piece, a + i, len, b, bn);
+		uint64_t carry = add_n(r + i, r + i, piece, len + bn);
+		carry = add_1(r + i + len + bn, an - i - len, carry);
+		assert(!carry);
+	}
+	free(piece);
+}
+
+// Size of at least size limbs for which mul_mod() is fast
+static size_t mod_size(size_t size)
+{
+	if (size < NTT_THRESHOLD)
+		return size;
+	size_t n = 2;
+	while (n < size)
+		n *= 2;
+	return n;
+}
+
+// r = a mod (B^n - 1), r has n limbs
+static void fold(uint64_t* r, size_t n, const uint64_t* a, size_t an)
+{
+	memset(r, 0, n * sizeof(uint64_t));
+	uint64_t carry = 0;
+	for (size_t i = 0; i < an; i += n) {
+		size_t len = (an - i < n) ? an - i : n;
+		carry += add_1(r + len, n - len, add_n(r, r, a + i, len));
+	}
+	while (carry)
+		carry = add_1(r, n, carry);
+}
+
+// r = a * b mod (B^n - 1) for n from mod_size(), r has n limbs
+static void mul_mod(uint64_t* r, size_t n, const uint64_t* a, size_t an,
+                    const uint64_t* b, size_t bn)
+{
+	if ((n >= NTT_THRESHOLD) && (an <= n) && (bn <= n)) {
+		mul_cyclic(r, n, a, an, b, bn);
+		return;
+	}
+	uint64_t* product = (uint64_t*)malloc((an + bn) * sizeof(uint64_t));
+	assert(product);
+	mul(product, a, an, b, bn);
+	fold(r, n, product, an + bn);
+	free(product);
+}
+
+// q = a / d, a = a % d with limbs above dn zeroed. q has an - dn + 1 limbs,
+// divisor has at least two limbs. Algorithm D of Knuth, TAOCP 4.3.1.
+static void divrem(uint64_t* q, uint64_t* a, size_t an, const uint64_t* d, size_t dn)
+{
+	assert((dn >= 2) && (an >= dn) && d[dn - 1]);
+	// Divisor is normalized so that quotient digits are estimated
+	// from the two highest limbs at most two too large
+	int shift = __builtin_clzll(d[dn - 1]);
+	uint64_t* tmp = (uint64_t*)malloc((an + 1 + dn) * sizeof(uint64_t));
+	assert(tmp);
+	uint64_t* u = tmp;
+	uint64_t* v = tmp + an + 1;
+	shift_left(v, d, dn, shift);
+	u[an] = shift_left(u, a, an, shift);
+
+	for (size_t j = an - dn + 1; j-- > 0; ) {
+		dlimb_t top = ((dlimb_t)u[j + dn] << 64) | u[j + dn - 1];
+		dlimb_t qhat = top / v[dn - 1];
+		dlimb_t rhat = top % v[dn - 1];
+		while ((qhat >> 64) ||
+		       (qhat * v[dn - 2] > ((rhat << 64) | u[j + dn - 2]))) {
+			qhat--;
+			rhat += v[dn - 1];
+			if (rhat >> 64)
+				break;
+		}
+
+		// u[j..j + dn] -= qhat * v
+		uint64_t carry = 0, borrow = 0, diff;
+		for (size_t i = 0; i < dn; i++) {
+			dlimb_t product = (dlimb_t)(uint64_t)qhat * v[i] + carry;
+			carry = (uint64_t)(product >> 64);
+			uint64_t overflow = __builtin_sub_overflow(u[i + j], (uint64_t)product, &diff);
+			overflow |= __builtin_sub_overflow(diff, borrow, &u[i + j]);
+			borrow = overflow;
+		}
+		uint64_t overflow = __builtin_sub_overflow(u[j + dn], carry, &diff);
+		overflow |= __builtin_sub_overflow(diff, borrow, &u[j + dn]);
+		if (overflow) {
+			// Estimate was one too large
+			qhat--;
+			u[j + dn] += add_n(u + j, u + j, v, dn);
+		}
+		q[j] = (uint64_t)qhat;
+	}
+
+	shift_right(a, u, dn, shift);
+	memset(a + dn, 0, (an - dn) * sizeof(uint64_t));
+	free(tmp);
+}
+
+// x of n + 1 limbs is floor(B^(2n) / d) up to a few units for normalized d
+// of n limbs, B = 2^64. Inverse of the higher half of d is refined by
+// a step of Newton method, x' = x + x * (B^(2n) - d * x) / B^(2n), which
+// squares relative error of the half, so that only rounding errors of
+// a few units remain. They are corrected by divisions.
+static void invert(uint64_t* x, const uint64_t* d, size_t n)
+{
+	if (n <= INVERSE_THRESHOLD) {
+		uint64_t* tmp = (uint64_t*)calloc(3 * n + 3, sizeof(uint64_t));
+		assert(tmp);
+		uint64_t* a = tmp;
+		uint64_t* q = tmp + 2 * n + 1;
+		a[2 * n] = 1;
+		divrem(q, a, 2 * n + 1, d, n);
+		assert(q[n + 1] == 0);
+		memcpy(x, q, (n + 1) * sizeof(uint64_t));
+		free(tmp);
+		return;
+	}
+
+	// Initial x is the inverse of the higher h limbs shifted by l limbs
+	size_t h = n - n / 2, l = n / 2;
+	memset(x, 0, l * sizeof(uint64_t));
+	invert(x + l, d + l, h);
+
+	uint64_t* t = (uint64_t*)calloc(2 * n + 2, sizeof(uint64_t));
+	assert(t);
+	uint64_t* u = (uint64_t*)malloc((2 * n + 2) * sizeof(uint64_t));
+	assert(u);
+	mul(t + l, d, n, x + l, h + 1);
+
+	// e = |B^(2n) - d * x|
+	int negative = t[2 * n] != 0;
+	if (negative) {
+		t[2 * n]--;
+	} else {
+		uint64_t* zero = u;
+		memset(zero, 0, 2 * n * sizeof(uint64_t));
+		sub_n(t, zero, t, 2 * n);
+	}
+	size_t e_size = trim(t, 2 * n + 1);
+	// Lower limbs of e change correction by less than a unit
+	size_t skip = (e_size > n - 2) ? n - 2 : e_size;
+	if (e_size > skip) {
+		uint64_t* product = (uint64_t*)malloc((h + 1 + e_size - skip) * sizeof(uint64_t));
+		assert(product);
+		mul(product, x + l, h + 1, t + skip, e_size - skip);
+		// Correction is product / B^(2n - l - skip)
+		if (h + 1 + e_size > n + h) {
+			size_t size = h + 1 + e_size - (n + h);
+			uint64_t* correction = product + n + h - skip;
+			assert(size <= n + 1);
+			if (negative)
+				sub_1(x + size, n + 1 - size, sub_n(x, x, correction, size));
+			else
+				add_1(x + size, n + 1 - size, add_n(x, x, correction, size));
+		}
+		free(product);
+	}
+	free(u);
+	free(t);
+}
+
+// Same as divrem() by Barrett reduction with inverse of the higher xn
+// limbs of normalized divisor: quotient is estimated from the higher limbs
+// of a by a multiplication by the inverse, multiplied back and corrected
+// by a few units. Either the whole divisor is inverted and an <= 2 * dn,
+// or the quotient has at most xn limbs.
+static void divrem_inverse(uint64_t* q, uint64_t* a, size_t an, const uint64_t* d,
+                           size_t dn, const uint64_t* inverse, size_t xn, int shift)
+{
+	size_t qn = an - dn + 1;
+	assert((an >= dn) && (((xn == dn) && (an <= 2 * dn)) || (qn <= xn)));
+	// Remainder differs from u - q * d for the estimate by a few d, which
+	// is less than B^(n - 1), so that it is found modulo B^n - 1
+	size_t n = mod_size(dn + 2);
+	uint64_t* tmp = (uint64_t*)calloc(an + 1 + qn + xn + 2 + 2 * n, sizeof(uint64_t));
+	assert(tmp);
+	uint64_t* u = tmp;
+	uint64_t* product = u + an + 1;
+	uint64_t* r = product + qn + xn + 2;
+	uint64_t* t = r + n;
+	u[an] = shift_left(u, a, an, shift);
+
+	// q = floor(floor(u / B^(dn - 1)) * inverse / B^(xn + 1))
+	mul(product, u + dn - 1, qn + 1, inverse, xn + 1);
+	uint64_t* quotient = product + xn + 1;
+	fold(r, n, u, an + 1);
+	mul_mod(t, n, quotient, qn + 1, d, dn);
+	// r - t + B^n - 1 if it is negative
+	if (sub_n(r, r, t, n))
+		sub_1(r, n, 1);
+	// Negative remainders are complemented, B^n - 1 is zero
+	if (r[n - 1])
+		add_1(r, n, 1);
+
+	// Inverse is off by a few units, so that estimate may be too large too
+	while (r[n - 1] >> 63) {
+		add_1(r + dn, n - dn, add_n(r, r, d, dn));
+		sub_1(quotient, qn + 1, 1);
+	}
+	while (compare(r, n, d, dn) >= 0) {
+		sub_1(r + dn, n - dn, sub_n(r, r, d, dn));
+		add_1(quotient, qn + 1, 1);
+	}
+
+	assert(quotient[qn] == 0);
+	memcpy(q, quotient, qn * sizeof(uint64_t));
+	shift_right(a, r, dn, shift);
+	memset(a + dn, 0, (an - dn) * sizeof(uint64_t));
+	free(tmp);
+}
+
+// Powers by which numbers of digits_num digits are split
+static void powers_init(powers_s* powers, size_t digits_num)
+{
+	memset(powers, 0, sizeof(*powers));
+	powers->limbs[0] = (uint64_t*)malloc(sizeof(uint64_t));
+	assert(powers->limbs[0]);
+	powers->limbs[0][0] = CHUNK_BASE;
+	powers->size[0] = 1;
+	powers->num = 1;
+	while (((size_t)CHUNK_DIGITS << powers->num) < digits_num) {
+		int k = powers->num++;
+		size_t size = powers->size[k - 1];
+		powers->limbs[k] = (uint64_t*)malloc(2 * size * sizeof(uint64_t));
+		assert(powers->limbs[k]);
+		mul_n(powers->limbs[k], powers->limbs[k - 1], powers->limbs[k - 1], size);
+		powers->size[k] = trim(powers->limbs[k], 2 * size);
+	}
+}
+
+// Inverts the higher inverse_size limbs of powers[k], which is enough
+// for quotients of that many limbs
+static void powers_prepare_division(powers_s* powers, int k, size_t inverse_size)
+{
+	if (powers->inverse[k])
+		return;
+	size_t size = powers->size[k];
+	if (inverse_size < 2)
+		inverse_size = 2;
+	if (inverse_size > size)
+		inverse_size = size;
+	powers->normalized[k] = (uint64_t*)malloc(size * sizeof(uint64_t));
+	assert(powers->normalized[k]);
+	powers->inverse[k] = (uint64_t*)malloc((inverse_size + 1) * sizeof(uint64_t));
+	assert(powers->inverse[k]);
+	powers->inverse_size[k] = inverse_size;
+	powers->shift[k] = __builtin_clzll(powers->limbs[k][size - 1]);
+	shift_left(powers->normalized[k], powers->limbs[k], size, powers->shift[k]);
+	invert(powers->inverse[k], powers->normalized[k] + size - inverse_size, inverse_size);
+}
+
+static void powers_free(powers_s* powers)
+{
+	for (int k = 0; k < powers->num; k++) {
+		free(powers->limbs[k]);
+		free(powers->normalized[k]);
+		free(powers->inverse[k]);
+	}
+	powers->num = 0;
+}
+
+// The biggest power of less than w digits
+static int split_power(size_t w)
+{
+	int k = 0;
+	while (((size_t)CHUNK_DIGITS << (k + 1)) < w)
+		k++;
+	return k;
+}
+
+// Digits are handled eight at a time as bytes of a word
+// (SWAR), which needs little-endian byte order
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define SWAR_DIGITS 1
+#else
+#define SWAR_DIGITS 0
+#endif
+
+static int is_digits_8(const char* str)
+{
+	uint64_t bytes;
+	memcpy(&bytes, str, sizeof(bytes));
+	// Highest bit of a byte is set if it is less than '0' or above '9'
+	return !(((bytes + 0x4646464646464646ULL) | (bytes - 0x3030303030303030ULL))
+	         & 0x8080808080808080ULL);
+}
+
+static int is_digits(const char* str, size_t len)
+{
+	size_t i = 0;
+	if (SWAR_DIGITS)
+		for (; i + 8 <= len; i += 8)
+			if (!is_digits_8(str + i))
+				return 0;
+	for (; i < len; i++)
+		if (!isdigit((unsigned char)str[i]))
+			return 0;
+	return 1;
+}
+
+static uint64_t parse_8(const char* str)
+{
+#if SWAR_DIGITS
+	uint64_t bytes;
+	memcpy(&bytes, str, sizeof(bytes));
+	bytes -= 0x3030303030303030ULL;
+	// Pairs of digits, then quads of them, then all eight
+	bytes = (bytes * 10 + (bytes >> 8)) & 0x00FF00FF00FF00FFULL;
+	bytes = (bytes * 100 + (bytes >> 16)) & 0x0000FFFF0000FFFFULL;
+	return (bytes * 10000 + (bytes >> 32)) & 0xFFFFFFFFULL;
+#else
+	uint64_t value = 0;
+	for (int i = 0; i < 8; i++)
+		value = value * 10 + (str[i] - '0');
+	return value;
+#endif
+}
+
+// Writes 8 digits of value < 10^8
+static void format_8(char* str, uint64_t value)
+{
+#if SWAR_DIGITS
+	// Halves, quarters and digits are split in lanes of 32, 16 and 8 bits,
+	// divisions by 100 and 10 are multiplications by their inverses
+	uint64_t halves = (value / 10000) | ((value % 10000) << 32);
+	uint64_t hundreds = ((halves * 10486) >> 20) & 0x0000007F0000007FULL;
+	uint64_t quarters = hundreds | ((halves - hundreds * 100) << 16);
+	uint64_t tens = ((quarters * 103) >> 10) & 0x000F000F000F000FULL;
+	uint64_t bytes = tens | ((quarters - tens * 10) << 8);
+	bytes += 0x3030303030303030ULL;
+	memcpy(str, &bytes, sizeof(bytes));
+#else
+	for (int i = 7; i >= 0; i--) {
+		str[i] = '0' + value % 10;
+		value /= 10;
+	}
+#endif
+}
+
+static uint64_t parse_chunk(const char* str, size_t len)
+{
+	uint64_t value = 0;
+	size_t i = 0;
+	for (; i < len % 8; i++)
+		value = value * 10 + (str[i] - '0');
+	for (; i < len; i += 8)
+		value = value * 100000000 + parse_8(str + i);
+	return value;
+}
+
+// Writes exactly len digits of value < 10^len
+static void format_chunk(char* str, size_t len, uint64_t value)
+{
+	char buf[CHUNK_DIGITS];
+	uint64_t high = value / 10000000000000000ULL;
+	value %= 10000000000000000ULL;
+	for (int i = 2; i >= 0; i--) {
+		buf[i] = '0' + high % 10;
+		high /= 10;
+	}
+	format_8(buf + 3, value / 100000000);
+	format_8(buf + 11, value % 100000000);
+	memcpy(str, buf + CHUNK_DIGITS - len, len);
+}
+
+// Number of threads which convert numbers
+static int conversion_threads(void)
+{
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	return (threads > 0) ? (int)threads : 1;
+}
+
+static void from_decimal(uint64_t* r, size_t rn, const char* digits, size_t w,
+                         const powers_s* powers, int threads);
+
+typedef struct {
+	uint64_t* r;
+	size_t rn;
+	const char* digits;
+	size_t w;
+	const powers_s* powers;
+	int threads;
+} from_decimal_args_s;
+
+static void* from_decimal_thread_func(void* arg)
+{
+	from_decimal_args_s* args = (from_decimal_args_s*)arg;
+	from_decimal(args->r, args->rn, args->digits, args->w, args->powers, args->threads);
+	return NULL;
+}
+
+// r of rn limbs = w digits, halves are converted by up to threads threads
+static void from_decimal(uint64_t* r, size_t rn, const char* digits, size_t w,
+                         const powers_s* powers, int threads)
+{
+	memset(r, 0, rn * sizeof(uint64_t));
+	if (w <= CHUNK_DIGITS * CONVERSION_THRESHOLD) {
+		size_t n = 0;
+		size_t len = (w % CHUNK_DIGITS) ? w % CHUNK_DIGITS : CHUNK_DIGITS;
+		for (size_t i = 0; i < w; i += len, len = CHUNK_DIGITS) {
+			uint64_t chunk = parse_chunk(digits + i, len);
+			uint64_t high = mul_1_add(r, n, POWERS_OF_TEN[len], chunk);
+			if (high) {
+				assert(n < rn);
+				r[n++] = high;
+			}
+		}
+		return;
+	}
+
+	// digits = high * 10^m + low
+	int k = split_power(w);
+	size_t m = (size_t)CHUNK_DIGITS << k;
+	size_t power_size = powers->size[k];
+	from_decimal_args_s low = {
+		.r = r,
+		.rn = (power_size < rn) ? power_size : rn,
+		.digits = digits + w - m,
+		.w = m,
+		.powers = powers,
+		.threads = threads / 2,
+	};
+	pthread_t thread;
+	int parallel = (threads > 1) && (w >= PARALLEL_DIGITS) &&
+	               !pthread_create(&thread, NULL, &from_decimal_thread_func, &low);
+	if (!parallel)
+		from_decimal_thread_func(&low);
+
+	size_t high_size = bignum_limbs(w - m);
+	uint64_t* high = (uint64_t*)malloc((2 * high_size + power_size) * sizeof(uint64_t));
+	assert(high);
+	from_decimal(high, high_size, digits, w - m, powers, threads - threads / 2);
+	if (parallel)
+		pthread_join(thread, NULL);
+	high_size = trim(high, high_size);
+	if (high_size > 0) {
+		uint64_t* product = high + high_size;
+		mul(product, high, high_size, powers->limbs[k], power_size);
+		size_t product_size = trim(product, high_size + power_size);
+		assert(product_size <= rn);
+		uint64_t carry = add_n(r, r, product, product_size);
+		carry = add_1(r + product_size, rn - product_size, carry);
+		assert(!carry);
+	}
+	free(high);
+}
+
+static void to_decimal(char* digits, size_t w, uint64_t* a, size_t an,
+                       const powers_s* powers, int threads);
+
+typedef struct {
+	char* digits;
+	size_t w;
+	uint64_t* a;
+	size_t an;
+	const powers_s* powers;
+	int threads;
+} to_decimal_args_s;
+
+static void* to_decimal_thread_func(void* arg)
+{
+	to_decimal_args_s* args = (to_decimal_args_s*)arg;
+	to_decimal(args->digits, args->w, args->a, args->an, args->powers, args->threads);
+	return NULL;
+}
+
+// Writes exactly w digits of a < 10^w, a is destroyed. Divisions by
+// all powers have to be prepared. Halves are converted by up to
+// threads threads.
+static void to_decimal(char* digits, size_t w, uint64_t* a, size_t an,
+                       const powers_s* powers, int threads)
+{
+	an = trim(a, an);
+	if (an <= CONVERSION_THRESHOLD) {
+		for (size_t i = w; i > 0; ) {
+			uint64_t chunk = div_1(a, an, CHUNK_BASE);
+			an = trim(a, an);
+			size_t len = (i < CHUNK_DIGITS) ? i : CHUNK_DIGITS;
+			i -= len;
+			format_chunk(digits + i, len, chunk);
+		}
+		return;
+	}
+
+	// a = high * 10^m + low
+	int k = split_power(w);
+	size_t m = (size_t)CHUNK_DIGITS << k;
+	size_t power_size = powers->size[k];
+	if (an < power_size) {
+		memset(digits, '0', w - m);
+		to_decimal(digits + w - m, m, a, an, powers, threads);
+		return;
+	}
+	size_t high_size = an - power_size + 1;
+	uint64_t* high = (uint64_t*)malloc(high_size * sizeof(uint64_t));
+	assert(high);
+	divrem_inverse(high, a, an, powers->normalized[k], power_size,
+	               powers->inverse[k], powers->inverse_size[k], powers->shift[k]);
+
+	to_decimal_args_s low = {
+		.digits = digits + w - m,
+		.w = m,
+		.a = a,
+		.an = power_size,
+		.powers = powers,
+		.threads = threads / 2,
+	};
+	pthread_t thread;
+	int parallel = (threads > 1) && (w >= PARALLEL_DIGITS) &&
+	               !pthread_create(&thread, NULL, &to_decimal_thread_func, &low);
+	if (!parallel)
+		to_decimal_thread_func(&low);
+	to_decimal(digits, w - m, high, high_size, powers, threads - threads / 2);
+	if (parallel)
+		pthread_join(thread, NULL);
+	free(high);
+}
+
+// Digits which are not contiguous in the file are copied
+static int copy_digits(FILE* file, digits_s* digits, size_t expected)
+{
+	digits->copy = (char*)malloc(expected + 1);
+	if (!digits->copy)
+		return 1;
+	size_t n = 0;
+	int c;
+	while ((n < expected) && ((c = getc(file)) != EOF)) {
+		if (isdigit(c))
+			digits->copy[n++] = (char)c;
+		else if (!isspace(c))
+			break;
+	}
+	digits->copy[n] = '\0';
+	digits->digits = digits->copy;
+	digits->num = n;
+	return n != expected;
+}
+
+// Takes digits right from the mapping if they are contiguous there
+static int map_digits(FILE* file, digits_s* digits)
+{
+	struct stat st;
+	if ((fstat(fileno(file), &st) != 0) || !S_ISREG(st.st_mode) || (st.st_size == 0))
+		return 1;
+	void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+	if (map == MAP_FAILED)
+		return 1;
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	digits->map = map;
+	digits->map_size = st.st_size;
+
+	const char* text = (const char*)map;
+	const char* end = text + st.st_size;
+	const char* ptr = text;
+	size_t expected = 0;
+	while ((ptr != end) && isspace((unsigned char)*ptr))
+		ptr++;
+	if ((ptr == end) || !isdigit((unsigned char)*ptr))
+		return 1;
+	while ((ptr != end) && isdigit((unsigned char)*ptr))
+		expected = expected * 10 + (*ptr++ - '0');
+	while ((ptr != end) && isspace((unsigned char)*ptr))
+		ptr++;
+	if (((size_t)(end - ptr) >= expected) && is_digits(ptr, expected)) {
+		digits->digits = ptr;
+		digits->num = expected;
+		return 0;
+	}
+	// Rare numbers split in lines are read as a stream
+	if (fseek(file, ptr - text, SEEK_SET) != 0)
+		return 1;
+	return copy_digits(file, digits, expected);
+}
+
+int bignum_read_digits(FILE* file, digits_s* digits)
+{
+	memset(digits, 0, sizeof(*digits));
+	int ret = map_digits(file, digits);
+	if (ret && !digits->map) {
+		// File can not be mapped
+		size_t expected;
+		if (fscanf(file, "%zu", &expected) != 1)
+			return 1;
+		ret = copy_digits(file, digits, expected);
+	}
+	if (ret)
+		bignum_free_digits(digits);
+	return ret;
+}
+
+void bignum_free_digits(digits_s* digits)
+{
+	if (digits->map)
+		munmap(digits->map, digits->map_size);
+	free(digits->copy);
+	memset(digits, 0, sizeof(*digits));
+}
+
+size_t bignum_limbs(size_t digits_num)
+{
+	return (size_t)(digits_num * LIMBS_PER_DIGIT) + 1;
+}
+
+size_t bignum_digits(size_t size)
+{
+	return (size_t)(size * DIGITS_PER_LIMB) + 1;
+}
+
+void bignum_from_decimal(uint64_t* limbs, size_t size,
+                         const char* digits, size_t digits_num)
+{
+	uint64_t* r = (uint64_t*)malloc(size * sizeof(uint64_t));
+	assert(r);
+	powers_s powers;
+	powers_init(&powers, digits_num);
+	from_decimal(r, size, digits, digits_num, &powers, conversion_threads());
+	powers_free(&powers);
+	for (size_t i = 0; i < size; i++)
+		limbs[i] = r[size - 1 - i];
+	free(r);
+}
+
+size_t bignum_to_decimal(char* digits, const uint64_t* limbs, size_t size)
+{
+	size_t w = bignum_digits(size);
+	uint64_t* a = (uint64_t*)malloc(size * sizeof(uint64_t));
+	assert(a);
+	for (size_t i = 0; i < size; i++)
+		a[i] = limbs[size - 1 - i];
+	powers_s powers;
+	powers_init(&powers, w);
+	// The biggest power divides only once, quotient of
+	// at most size - powers.size[k] + 1 limbs
+	for (int k = 1; k < powers.num; k++) {
+		size_t inverse_size = powers.size[k];
+		if ((k == powers.num - 1) && (size >= powers.size[k]))
+			inverse_size = size - powers.size[k] + 1;
+		powers_prepare_division(&powers, k, inverse_size);
+	}
+	to_decimal(digits, w, a, size, &powers, conversion_threads());
+	powers_free(&powers);
+	free(a);
+
+	size_t zeros = 0;
+	while ((zeros + 1 < w) && (digits[zeros] == '0'))
+		zeros++;
+	memmove(digits, digits + zeros, w - zeros);
+	digits[w - zeros] = '\0';
+	return w - zeros;
+}
+
+int bignum_add(uint64_t* result, const uint64_t* term1, const uint64_t* term2,
+               size_t size, int carry)
+{
+	uint64_t overflow = carry;
+	for (size_t i = size; i-- > 0; ) {
+		uint64_t sum;
+		uint64_t carry_out = __builtin_add_overflow(term1[i], term2[i], &sum);
+		carry_out |= __builtin_add_overflow(sum, overflow, &result[i]);
+		overflow = carry_out;
+	}
+	return (int)overflow;
+}
+
+int bignum_parse_decimal(uint64_t* limbs, size_t size, const char* digits)
+{
+	if (!is_digits(digits, size * BIGNUM_DECIMAL_DIGITS))
+		return 1;
+	for (size_t i = 0; i < size; i++)
+		limbs[i] = parse_chunk(digits + i * BIGNUM_DECIMAL_DIGITS, BIGNUM_DECIMAL_DIGITS);
+	return 0;
+}
+
+void bignum_format_decimal(char* digits, const uint64_t* limbs, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+		format_chunk(digits + i * BIGNUM_DECIMAL_DIGITS, BIGNUM_DECIMAL_DIGITS, limbs[i]);
+}
+
+int bignum_add_decimal(uint64_t* result, const uint64_t* term1,
+                       const uint64_t* term2, size_t size, int carry)
+{
+	// Sum of two limbs and carry is less than 2^64
+	uint64_t overflow = carry;
+	for (size_t i = size; i-- > 0; ) {
+		uint64_t sum = term1[i] + term2[i] + overflow;
+		overflow = sum >= BIGNUM_DECIMAL_BASE;
+		result[i] = sum - (overflow ? BIGNUM_DECIMAL_BASE : 0);
+	}
+	return (int)overflow;
+}
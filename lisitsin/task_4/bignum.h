@@ -0,0 +1,73 @@
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+// Big numbers as arrays of binary 64-bit limbs, the most significant
+// limb first like digits of decimal input. Adders work on limbs only,
+// decimal digits are converted once when numbers are read and printed.
+// Conversions split numbers in halves by cached powers 10^(19 * 2^k), so
+// they take O(M(n) log n) instead of n^2 / 2 limb operations of converting
+// 19 digits at a time. Long numbers are multiplied by number theoretic
+// transform modulo three primes, M(n) = O(n log n), and divided by the
+// powers with their inverses. Halves of long numbers are converted by
+// different threads, and digits are parsed and formatted eight at a time.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Digits of a number, the most significant first, not terminated
+typedef struct {
+	const char* digits;
+	size_t num;
+	// Mapping of the file, digits point into it unless
+	// they are separated by whitespace and are copied
+	void* map;
+	size_t map_size;
+	char* copy;
+} digits_s;
+
+// Reads number of digits and digits of a number from file. Digits may
+// be separated by whitespace. Returns 0 on success.
+int bignum_read_digits(FILE* file, digits_s* digits);
+
+void bignum_free_digits(digits_s* digits);
+
+// Number of limbs enough for any number of digits_num decimal digits
+size_t bignum_limbs(size_t digits_num);
+
+// Number of decimal digits enough for any number of size limbs
+size_t bignum_digits(size_t size);
+
+// Converts digits_num decimal digits into size limbs, higher limbs
+// are zero. Number has to fit into size limbs.
+void bignum_from_decimal(uint64_t* limbs, size_t size,
+                         const char* digits, size_t digits_num);
+
+// Writes decimal digits of size limbs without leading zeros(but "0" for
+// zero) and terminating '\0' into digits, which has room for
+// bignum_digits(size) + 1 chars. Returns number of digits.
+size_t bignum_to_decimal(char* digits, const uint64_t* limbs, size_t size);
+
+// result = term1 + term2 + carry, result may be one of the terms.
+// Returns carry out of the most significant limb.
+int bignum_add(uint64_t* result, const uint64_t* term1, const uint64_t* term2,
+               size_t size, int carry);
+
+// Decimal limbs of BIGNUM_DECIMAL_DIGITS digits each. Unlike binary
+// limbs, any slice of digits is converted on its own, so that slices
+// of a number are read, added and written by different processes.
+#define BIGNUM_DECIMAL_DIGITS 18
+#define BIGNUM_DECIMAL_BASE 1000000000000000000ULL
+
+// Converts size * BIGNUM_DECIMAL_DIGITS digits into size decimal limbs.
+// Returns 0 on success, 1 if there are not only digits.
+int bignum_parse_decimal(uint64_t* limbs, size_t size, const char* digits);
+
+// Writes size * BIGNUM_DECIMAL_DIGITS digits of size decimal limbs
+void bignum_format_decimal(char* digits, const uint64_t* limbs, size_t size);
+
+// Same as bignum_add() for decimal limbs
+int bignum_add_decimal(uint64_t* result, const uint64_t* term1,
+                       const uint64_t* term2, size_t size, int carry);
+
+#endif
@@ -5,16 +5,24 @@
 #include <mpi.h>
 #include <math.h>
 #include <string.h>
+#include <limits.h>
+#include <inttypes.h>
 
-// Number of blocks per worker
-#define GRANULARITY 2
+#include "bignum.h"
+
+// Chunk taken from a queue is this part of its remaining limbs
+#define GUIDED_DIVISOR 2
+// Minimal chunk takes this many times longer to add than to take
+#define OVERHEAD_RATIO 10
 
 int MPI_SIZE = 0;
 
+// Flags of a task at its first limb, zero for other limbs
 enum {
-	TAG_OK = 0,
-	TAG_FAIL,
-	TAG_DATA,
+	FLAG_BEGIN = 1,
+	FLAG_SPECULATED = 2,
+	FLAG_CARRY1 = 4,
+	FLAG_CARRY2 = 8,
 };
 
 typedef struct {
@@ -25,282 +33,374 @@ typedef struct {
 	int origin;
 	int size;
 	int speculated;
-	int* term1;
-	int* term2;
-	int* res1;
-	int* res2;
+	uint64_t* term1;
+	uint64_t* term2;
+	uint64_t* res1;
+	uint64_t* res2;
 	int carry1;
 	int carry2;
 } task_s;
 
+// Running totals of costs measured by a process
+typedef struct {
+	double limbs_time;
+	long long limbs;
+	double messages_time;
+	int messages;
+} pace_s;
+
+// Limbs of a process and windows through which other processes steal them
+typedef struct {
+	int term_size;
+	range_s range;
+	// term1 limbs followed by term2 limbs
+	uint64_t* terms;
+	MPI_Win terms_win;
+	// res1 limbs followed by res2 limbs
+	uint64_t* results;
+	MPI_Win results_win;
+	unsigned char* flags;
+	MPI_Win flags_win;
+	// Number of limbs taken from the queue
+	int* taken;
+	MPI_Win queue_win;
+	pace_s pace;
+} queue_s;
+
 void graceful_abort(int signum)
 {
 	fprintf(stderr, "ERROR");
 	MPI_Abort(MPI_COMM_WORLD, 1);
 }
 
-void print_array(const char* prefix, const int* arr, int size)
+void print_array(const char* prefix, const uint64_t* arr, int size)
 {
 	fprintf(stderr, "%s", prefix);
 	for (int i = 0; i < size; i++) {
-		fprintf(stderr, "%09d", arr[i]);
+		fprintf(stderr, "%016" PRIx64, arr[i]);
 	}
 	fprintf(stderr, "\n");
 }
 
-// It is responsibility of the caller to free result
-int* perform_task(task_s* task) {
-	int* term1 = task->term1;
-	int* term2 = task->term2;
+// Writes sums into res1 and, if it speculates, res2 of the task
+void perform_task(task_s* task) {
+	uint64_t* term1 = task->term1;
+	uint64_t* term2 = task->term2;
 	int size = task->size;
 
 	// We only speculate if we can not constrain
 	// effect of carry from less significant digits
-	int will_speculate = (term1[size-1] + term2[size-1] == 999999999);
+	int will_speculate = (term1[size-1] + term2[size-1] == UINT64_MAX);
 #ifdef DEBUG_PRINT
 	if (will_speculate)
 		fprintf(stderr, "will speculate\n");
 #endif
 
-	int* result1 = (int*)malloc(size * sizeof(int));
-	assert(result1);
+	task->carry1 = bignum_add(task->res1, term1, term2, size, 0);
+	task->carry2 = 0;
+	task->speculated = will_speculate;
+	if (will_speculate)
+		task->carry2 = bignum_add(task->res2, term1, term2, size, 1);
+}
+
+// Limbs of a process, the most significant ones belong to root
+range_s process_range(int rank, int term_size)
+{
+	range_s range;
+	range.begin = (int)((long long)term_size * rank / MPI_SIZE);
+	range.end   = (int)((long long)term_size * (rank + 1) / MPI_SIZE);
+	return range;
+}
 
-	int* result2;
-	if (will_speculate) {
-		result2 = (int*)malloc(size * sizeof(int));
-		assert(result2);
+// Guided chunk: a part of the remaining limbs, but not so small
+// that taking it is long compared to adding it
+int chunk_size(const pace_s* pace, int remaining, int max_size)
+{
+	int size = remaining / GUIDED_DIVISOR;
+	if (pace->messages && pace->limbs_time > 0) {
+		double limb_time = pace->limbs_time / pace->limbs;
+		double message_time = pace->messages_time / pace->messages;
+		double min_size = OVERHEAD_RATIO * message_time / limb_time;
+		if (size < min_size)
+			size = (min_size < remaining) ? (int)min_size : remaining;
 	}
+	if (size < 1)
+		size = 1;
+	return (size < max_size) ? size : max_size;
+}
 
-	int carry1 = 0, carry2 = 1;
+// Takes the next chunk of at most max_size limbs from victim's queue of
+// limbs_num limbs. Returns its size and first limb, 0 if queue is empty.
+int take_chunk(queue_s* queue, int victim, int limbs_num, int max_size, int* begin)
+{
+	double start = MPI_Wtime();
+	int taken = 0, size = 0;
+	MPI_Fetch_and_op(NULL, &taken, MPI_INT, victim, 0, MPI_NO_OP, queue->queue_win);
+	MPI_Win_flush(victim, queue->queue_win);
+	while (taken < limbs_num) {
+		size = chunk_size(&queue->pace, limbs_num - taken, max_size);
+		int next = taken + size, old = 0;
+		MPI_Compare_and_swap(&next, &taken, &old, MPI_INT, victim, 0, queue->queue_win);
+		MPI_Win_flush(victim, queue->queue_win);
+		if (old == taken)
+			break;
+		taken = old;
+	}
+	queue->pace.messages_time += MPI_Wtime() - start;
+	queue->pace.messages++;
 
-	for (int i = size - 1; i >= 0; i--) {
+	*begin = taken;
+	return (taken < limbs_num) ? size : 0;
+}
 
-		result1[i] = term1[i] + term2[i] + carry1;
-		carry1 = result1[i] > 999999999;
-		result1[i] %= 1000000000;
+// Adds the chunk and measures time of it
+void add_chunk(queue_s* queue, task_s* task)
+{
+	double start = MPI_Wtime();
+	perform_task(task);
+	queue->pace.limbs_time += MPI_Wtime() - start;
+	queue->pace.limbs += task->size;
 #ifdef DEBUG_PRINT
-		fprintf(stderr, "sum[%d] = %09d\n", i, result1[i]);
+	print_array("  ", task->term1, task->size);
+	print_array(" +", task->term2, task->size);
+	print_array(" =", task->res1,  task->size);
 #endif
-		if (will_speculate) {
-			result2[i] = term1[i] + term2[i] + carry2;
-			carry2 = result2[i] > 999999999;
-			result2[i] %= 1000000000;
-		}
-	}
+}
 
-	task->res1 = result1;
-	task->carry1 = carry1;
-	task->speculated = will_speculate;
-	if (will_speculate) {
-		task->res2 = result2;
-		task->carry2 = carry2;
-	}
+unsigned char task_flags(const task_s* task)
+{
+	return FLAG_BEGIN |
+	       (task->speculated ? FLAG_SPECULATED : 0) |
+	       (task->carry1 ? FLAG_CARRY1 : 0) |
+	       (task->carry2 ? FLAG_CARRY2 : 0);
 }
 
-void worker_func(int rank)
+void perform_own_chunk(queue_s* queue, int begin, int size)
 {
-	assert((rank <= MPI_SIZE - 1) && (rank >= 1));
-	int is_task_completed = 0;
-	MPI_Send(&is_task_completed, 1, MPI_INT, 0, TAG_OK, MPI_COMM_WORLD);
-
-	MPI_Status status = {};
-	while (1) {
-		int task_num;
-		int size;
-
-		MPI_Recv(&task_num, 1, MPI_INT,
-			0, MPI_ANY_TAG,
-			MPI_COMM_WORLD, &status);
-		if (status.MPI_TAG == TAG_FAIL) {
-			assert(task_num == -1);
-			break;
-		}
-		assert(task_num >= 0 && status.MPI_TAG == TAG_OK);
-
-		MPI_Recv(&size, 1, MPI_INT,
-			0, TAG_DATA,
-			MPI_COMM_WORLD, NULL);
-		assert(size > 0);
-
-		int* term1 = (int*)malloc(size * sizeof(term1[0]));
-		assert(term1);
-		int* term2 = (int*)malloc(size * sizeof(term2[0]));
-		assert(term2);
-
-		MPI_Recv(term1, size, MPI_INT,
-			0, TAG_DATA,
-			MPI_COMM_WORLD, NULL);
-		MPI_Recv(term2, size, MPI_INT,
-			0, TAG_DATA,
-			MPI_COMM_WORLD, NULL);
-
-		// Perform task
-		task_s task = {
-			.size = size,
-			.term1 = term1,
-			.term2 = term2,
-		};
-
-		// perform_task() sets 'res1' and probably 'res2'
-		// to newly allocated buffers which we have
-		// to free. Also it sets 'carry1', 'carry2' and
-		// 'speculated'
-		perform_task(&task);
+	int limbs_num = queue->range.end - queue->range.begin;
+	task_s task = {
+		.size  = size,
+		.term1 = queue->terms + begin,
+		.term2 = queue->terms + limbs_num + begin,
+		.res1  = queue->results + begin,
+		.res2  = queue->results + limbs_num + begin,
+	};
+	add_chunk(queue, &task);
+	queue->flags[begin] = task_flags(&task);
+}
+
+// Gets terms of the chunk from victim's window
+// and puts the sum right into its results
+void perform_stolen_chunk(queue_s* queue, int victim, int begin, int size, uint64_t* buf)
+{
+	range_s range = process_range(victim, queue->term_size);
+	int limbs_num = range.end - range.begin;
+	task_s task = {
+		.size  = size,
+		.term1 = buf,
+		.term2 = buf + size,
+		.res1  = buf + 2 * size,
+		.res2  = buf + 3 * size,
+	};
+	MPI_Get(task.term1, size, MPI_UINT64_T,
+		victim, begin, size, MPI_UINT64_T,
+		queue->terms_win);
+	MPI_Get(task.term2, size, MPI_UINT64_T,
+		victim, limbs_num + begin, size, MPI_UINT64_T,
+		queue->terms_win);
+	MPI_Win_flush(victim, queue->terms_win);
+
+	add_chunk(queue, &task);
 #ifdef DEBUG_PRINT
-		print_array("  ", term1,     size);
-		print_array(" +", term2,     size);
-		print_array(" =", task.res1, size);
-		fprintf(stderr, "\n");
+	fprintf(stderr, "%d limbs from %d of %d are stolen\n", size, begin, victim);
 #endif
 
-		is_task_completed = 1;
-		MPI_Send(&is_task_completed, 1,    MPI_INT, 0, TAG_OK,   MPI_COMM_WORLD);
-		MPI_Send(&task_num,          1,    MPI_INT, 0, TAG_DATA, MPI_COMM_WORLD);
-		MPI_Send(&task.speculated,   1,    MPI_INT, 0, TAG_DATA, MPI_COMM_WORLD);
-		MPI_Send(&task.carry1,       1,    MPI_INT, 0, TAG_DATA, MPI_COMM_WORLD);
-		MPI_Send(task.res1,          size, MPI_INT, 0, TAG_DATA, MPI_COMM_WORLD);
-		if (task.speculated) {
-			MPI_Send(&task.carry2, 1,    MPI_INT, 0, TAG_DATA, MPI_COMM_WORLD);
-			MPI_Send(task.res2,    size, MPI_INT, 0, TAG_DATA, MPI_COMM_WORLD);
-		}
+	unsigned char flags = task_flags(&task);
+	MPI_Put(task.res1, size, MPI_UINT64_T,
+		victim, begin, size, MPI_UINT64_T,
+		queue->results_win);
+	if (task.speculated)
+		MPI_Put(task.res2, size, MPI_UINT64_T,
+			victim, limbs_num + begin, size, MPI_UINT64_T,
+			queue->results_win);
+	MPI_Put(&flags, 1, MPI_UNSIGNED_CHAR,
+		victim, begin, 1, MPI_UNSIGNED_CHAR,
+		queue->flags_win);
+	MPI_Win_flush(victim, queue->results_win);
+	MPI_Win_flush(victim, queue->flags_win);
+}
 
-		free(term1);
-		free(term2);
-		free(task.res1);
-		if (task.speculated)
-			free(task.res2);
+// Adds limbs of the terms scattered from root, every process adds
+// its own limbs and then steals limbs of random victims, in chunks
+// that shrink as queues run out. Root gets sums of chunks
+// into res1 and res2, and flags of chunks at their first limbs.
+void add_limbs(int rank, const uint64_t* term1, const uint64_t* term2, int term_size,
+                uint64_t* res1, uint64_t* res2, unsigned char* flags)
+{
+	MPI_Bcast(&term_size, 1, MPI_INT, 0, MPI_COMM_WORLD);
+	queue_s queue = {0};
+	queue.term_size = term_size;
+	queue.range = process_range(rank, term_size);
+	int limbs_num = queue.range.end - queue.range.begin;
+
+	MPI_Win_allocate(2 * limbs_num * sizeof(uint64_t), sizeof(uint64_t),
+	                 MPI_INFO_NULL, MPI_COMM_WORLD, &queue.terms, &queue.terms_win);
+	MPI_Win_allocate(2 * limbs_num * sizeof(uint64_t), sizeof(uint64_t),
+	                 MPI_INFO_NULL, MPI_COMM_WORLD, &queue.results, &queue.results_win);
+	MPI_Win_allocate(limbs_num, 1,
+	                 MPI_INFO_NULL, MPI_COMM_WORLD, &queue.flags, &queue.flags_win);
+	MPI_Win_allocate(sizeof(int), sizeof(int),
+	                 MPI_INFO_NULL, MPI_COMM_WORLD, &queue.taken, &queue.queue_win);
+	memset(queue.flags, 0, limbs_num);
+	*queue.taken = 0;
+
+	int* counts = (int*)malloc(MPI_SIZE * sizeof(int));
+	assert(counts);
+	int* displs = (int*)malloc(MPI_SIZE * sizeof(int));
+	assert(displs);
+	for (int i = 0; i < MPI_SIZE; i++) {
+		range_s range = process_range(i, term_size);
+		counts[i] = range.end - range.begin;
+		displs[i] = range.begin;
 	}
-
+	MPI_Scatterv(term1, counts, displs, MPI_UINT64_T,
+	             queue.terms, limbs_num, MPI_UINT64_T,
+	             0, MPI_COMM_WORLD);
+	MPI_Scatterv(term2, counts, displs, MPI_UINT64_T,
+	             queue.terms + limbs_num, limbs_num, MPI_UINT64_T,
+	             0, MPI_COMM_WORLD);
+
+	// Queues are ready when all processes have initialized them
+	MPI_Barrier(MPI_COMM_WORLD);
+	MPI_Win_lock_all(0, queue.queue_win);
+	MPI_Win_lock_all(0, queue.terms_win);
+	MPI_Win_lock_all(0, queue.results_win);
+	MPI_Win_lock_all(0, queue.flags_win);
+
+	int begin, size;
+	while ((size = take_chunk(&queue, rank, limbs_num, INT_MAX, &begin)) != 0)
+		perform_own_chunk(&queue, begin, size);
+
+	// Queues never grow, so once a victim is found empty, it is
+	// not visited again, and process stops when all are empty
+	int* victims = (int*)malloc(MPI_SIZE * sizeof(int));
+	assert(victims);
+	for (int i = 0; i < MPI_SIZE; i++)
+		victims[i] = i;
+	srand(rank + 1);
+	for (int i = MPI_SIZE - 1; i > 0; i--) {
+		int j = rand() % (i + 1);
+		int victim = victims[i];
+		victims[i] = victims[j];
+		victims[j] = victim;
+	}
+	// Chunks are never longer than half of the largest queue
+	int max_size = ((term_size + MPI_SIZE - 1) / MPI_SIZE + 1) / 2;
+	uint64_t* buf = (uint64_t*)malloc(4 * (size_t)max_size * sizeof(uint64_t));
+	assert(buf);
+	for (int i = 0; i < MPI_SIZE; i++) {
+		if (victims[i] == rank)
+			continue;
+		int victim_limbs = counts[victims[i]];
+		while ((size = take_chunk(&queue, victims[i], victim_limbs, max_size, &begin)) != 0)
+			perform_stolen_chunk(&queue, victims[i], begin, size, buf);
+	}
+	free(buf);
+	free(victims);
+
+	// All chunks are taken, and results of stolen
+	// ones are in place when everyone is done
+	MPI_Barrier(MPI_COMM_WORLD);
+	MPI_Win_sync(queue.results_win);
+	MPI_Win_sync(queue.flags_win);
+	MPI_Win_unlock_all(queue.flags_win);
+	MPI_Win_unlock_all(queue.results_win);
+	MPI_Win_unlock_all(queue.terms_win);
+	MPI_Win_unlock_all(queue.queue_win);
+
+	MPI_Gatherv(queue.results, limbs_num, MPI_UINT64_T,
+	            res1, counts, displs, MPI_UINT64_T,
+	            0, MPI_COMM_WORLD);
+	MPI_Gatherv(queue.results + limbs_num, limbs_num, MPI_UINT64_T,
+	            res2, counts, displs, MPI_UINT64_T,
+	            0, MPI_COMM_WORLD);
+	MPI_Gatherv(queue.flags, limbs_num, MPI_UNSIGNED_CHAR,
+	            flags, counts, displs, MPI_UNSIGNED_CHAR,
+	            0, MPI_COMM_WORLD);
+
+	free(counts);
+	free(displs);
+	MPI_Win_free(&queue.queue_win);
+	MPI_Win_free(&queue.flags_win);
+	MPI_Win_free(&queue.results_win);
+	MPI_Win_free(&queue.terms_win);
 }
 
 void root_func(FILE* file1, FILE* file2)
 {
 	int r = 0;
 	int rank = 0;
-	int size1, size2;
-
-	fscanf(file1, "%d ", &size1);
-	fscanf(file2, "%d ", &size2);
-
-	int term_size = (size1 > size2) ? size1 : size2;
-	term_size = (term_size % 9) ? term_size / 9 + 1 : term_size / 9;
+	digits_s digits1, digits2;
+	int ret = bignum_read_digits(file1, &digits1);
+	assert(ret == 0);
+	ret = bignum_read_digits(file2, &digits2);
+	assert(ret == 0);
+	size_t size1 = digits1.num, size2 = digits2.num;
+
+	int term_size = (int)bignum_limbs((size1 > size2) ? size1 : size2);
 #ifdef DEBUG_PRINT
-	fprintf(stderr, "ROOT: size1 = %d, size2 = %d\n", size1, size2);
+	fprintf(stderr, "ROOT: size1 = %zu, size2 = %zu\n", size1, size2);
 #endif
 
-	int* term1 = (int*)malloc(term_size * sizeof(term1[0]));
+	uint64_t* term1 = (uint64_t*)malloc(term_size * sizeof(term1[0]));
 	assert(term1);
-	int* term2 = (int*)malloc(term_size * sizeof(term2[0]));
+	uint64_t* term2 = (uint64_t*)malloc(term_size * sizeof(term2[0]));
 	assert(term2);
 
-	int i = 0;
-	while (fscanf(file1, "%9d", &term1[i++]) == 1);
+	bignum_from_decimal(term1, term_size, digits1.digits, size1);
+	bignum_from_decimal(term2, term_size, digits2.digits, size2);
+	bignum_free_digits(&digits1);
+	bignum_free_digits(&digits2);
 
-	i = 0;
-	while (fscanf(file2, "%9d", &term2[i++]) == 1);
+	uint64_t* buf1 = (uint64_t*)malloc(term_size * sizeof(buf1[0]));
+	assert(buf1);
+	uint64_t* buf2 = (uint64_t*)malloc(term_size * sizeof(buf2[0]));
+	assert(buf2);
+	unsigned char* flags = (unsigned char*)malloc(term_size);
+	assert(flags);
 
-	// Distribute tasks
-	int workers_num = MPI_SIZE - 1;
-	int block_size = term_size / (GRANULARITY * workers_num);
-	if (block_size == 0) {
-		fprintf(stderr, "Too many processes for current task\n");
-		assert(block_size > 0);
-	}
 	double start = MPI_Wtime();
+	add_limbs(rank, term1, term2, term_size, buf1, buf2, flags);
 
-	int* buf1 = (int*)malloc(term_size * sizeof(buf1[0]));
-	assert(buf1);
-	int* buf2 = (int*)malloc(term_size * sizeof(buf1[0]));
-	assert(buf1);
-
-	// Initialize tasks
-	int tasks_num = term_size / block_size;
+	// Every chunk is a task from its first limb to the next one
+	int tasks_num = 0;
+	for (int i = 0; i < term_size; i++)
+		tasks_num += (flags[i] & FLAG_BEGIN) != 0;
 #ifdef DEBUG_PRINT
-	fprintf(stderr, "term_size = %d(%d digits), workers_num = %d, tasks_num = %d, block_size = %d, block_num_per_worker = %d\n",
-			term_size, term_size * 9, workers_num, tasks_num, block_size, GRANULARITY);
+	fprintf(stderr, "term_size = %d(%zu digits), processes_num = %d, tasks_num = %d\n",
+			term_size, (size1 > size2) ? size1 : size2, MPI_SIZE, tasks_num);
 #endif
 	task_s* task_pool = (task_s*)calloc(tasks_num, sizeof(*task_pool));
-	for (int i = 0; i < tasks_num; i++) {
-		task_pool[i].origin = i * block_size;
-		task_pool[i].speculated = 0;
-		task_pool[i].size   = block_size;
-		task_pool[i].term1  = &term1[i * block_size];
-		task_pool[i].term2  = &term2[i * block_size];
-		task_pool[i].res1   = &buf1[i * block_size];
-		task_pool[i].res2   = &buf2[i * block_size];
-		task_pool[i].carry1 = 0;
-		task_pool[i].carry2 = 0;
-	}
-
-	int assigned_tasks = 0;
-	int completed_tasks = 0;
-	int cur_worker = 0;
-	MPI_Status status = {};
-	while (completed_tasks < tasks_num) {
-		int is_task_completed;
-		// Worker either just entered or
-		// already accomplished some task
-		MPI_Recv(&is_task_completed, 1, MPI_INT,
-		         MPI_ANY_SOURCE, TAG_OK,
-			 MPI_COMM_WORLD, &status);
-		cur_worker = status.MPI_SOURCE;
-
-		if (is_task_completed) {
-			int task_num;
-			// Get results
-			MPI_Recv(&task_num, 1, MPI_INT,
-				cur_worker, TAG_DATA,
-				MPI_COMM_WORLD, NULL);
-
-			task_s* t = &task_pool[task_num];
-
-			MPI_Recv(&t->speculated, 1, MPI_INT,
-				cur_worker, TAG_DATA,
-				MPI_COMM_WORLD, NULL);
-			MPI_Recv(&t->carry1, 1, MPI_INT,
-				cur_worker, TAG_DATA,
-				MPI_COMM_WORLD, NULL);
-			MPI_Recv(t->res1, t->size, MPI_INT,
-				cur_worker, TAG_DATA,
-				MPI_COMM_WORLD, NULL);
-			if (task_pool[task_num].speculated) {
-				MPI_Recv(&t->carry2, 1, MPI_INT,
-					cur_worker, TAG_DATA,
-					MPI_COMM_WORLD, NULL);
-				MPI_Recv(t->res2, task_pool[task_num].size, MPI_INT,
-					cur_worker, TAG_DATA,
-					MPI_COMM_WORLD, NULL);
-			}
-			completed_tasks++;
-		}
-
-		if (assigned_tasks < tasks_num) {
-			int task_num = assigned_tasks;
-			task_s* t = &task_pool[task_num];
-			// Assign new task
-			MPI_Send(&task_num, 1, MPI_INT,
-				cur_worker, TAG_OK,
-				MPI_COMM_WORLD);
-			MPI_Send(&t->size, 1, MPI_INT,
-				cur_worker, TAG_DATA,
-				MPI_COMM_WORLD);
-			MPI_Send(t->term1, t->size, MPI_INT,
-				cur_worker, TAG_DATA,
-				MPI_COMM_WORLD);
-			MPI_Send(t->term2, t->size, MPI_INT,
-				cur_worker, TAG_DATA,
-				MPI_COMM_WORLD);
-			assigned_tasks++;
-		} else {
-			int placeholder = -1;
-			MPI_Send(&placeholder, 1, MPI_INT,
-				cur_worker, TAG_FAIL,
-				MPI_COMM_WORLD);
+	assert(task_pool);
+	for (int i = 0, t = -1; i < term_size; i++) {
+		if (flags[i] & FLAG_BEGIN) {
+			t++;
+			task_pool[t].origin = i;
+			task_pool[t].term1  = &term1[i];
+			task_pool[t].term2  = &term2[i];
+			task_pool[t].res1   = &buf1[i];
+			task_pool[t].res2   = &buf2[i];
+			task_pool[t].speculated = (flags[i] & FLAG_SPECULATED) != 0;
+			task_pool[t].carry1 = (flags[i] & FLAG_CARRY1) != 0;
+			task_pool[t].carry2 = (flags[i] & FLAG_CARRY2) != 0;
 		}
+		task_pool[t].size++;
 	}
 
-	int* result = (int*)malloc(term_size * sizeof(result[0]));
-	assert(result);
+	// Carry is the most significant limb of the sum
+	uint64_t* sum = (uint64_t*)malloc((term_size + 1) * sizeof(sum[0]));
+	assert(sum);
+	uint64_t* result = sum + 1;
 
 	int carry = 0;
 	for (int i = tasks_num - 1; i >= 0; i--) {
@@ -308,18 +408,18 @@ void root_func(FILE* file1, FILE* file2)
 
 		if ((carry == 1) && (t->speculated)) {
 			memcpy(&result[t->origin], t->res2,
-			       t->size * sizeof(int));
+			       t->size * sizeof(uint64_t));
 			carry = t->carry2;
 			continue;
 		}
 
 		memcpy(&result[t->origin], t->res1,
-		       t->size * sizeof(int));
+		       t->size * sizeof(uint64_t));
 		if (carry == 1) {
 			// Our algorithm guarantees that if
 			// t%d: here was no speculation then
 			// effect of carry being equal to one
-			// is constrained to the rightmost int
+			// is constrained to the rightmost limb
 			result[t->origin + t->size - 1]++;
 		}
 		carry = t->carry1;
@@ -329,27 +429,32 @@ void root_func(FILE* file1, FILE* file2)
 	fprintf(stderr, "ROOT: carry = %d\n", carry);
 #endif
 
+	sum[0] = carry;
+	// Conversion of the sum is not a part of the addition
+	double time = MPI_Wtime() - start;
+
+	char* digits = (char*)malloc(bignum_digits(term_size + 1) + 1);
+	assert(digits);
 #ifdef DEBUG_PRINT
-	printf("     %s", carry ? " " : "");
-	for (int i = 0; i < term_size; i++)
-		printf("%09d", term1[i]);
-	printf("\n  +\n");
-	printf("     %s", carry ? " " : "");
-	for (int i = 0; i < term_size; i++)
-		printf("%09d", term2[i]);
-	printf("\n");
+	bignum_to_decimal(digits, term1, term_size);
+	printf("      %s\n  +\n", digits);
+	bignum_to_decimal(digits, term2, term_size);
+	printf("      %s\n", digits);
 #endif
-	printf("Sum: %s", carry ? "1" : "");
-	for (int i = 0; i < term_size; i++)
-		printf("%09d", result[i]);
-	printf("\nTime elapsed: %lg\n", MPI_Wtime() - start);
+	size_t digits_num = bignum_to_decimal(digits, sum, term_size + 1);
+	fputs("Sum: ", stdout);
+	fwrite(digits, 1, digits_num, stdout);
+	printf("\nTime elapsed: %lg\n", time);
 	fflush(stdout);
 
-	free(result);
+	free(digits);
+	free(sum);
 	free(term1);
 	free(term2);
 	free(buf1);
 	free(buf2);
+	free(flags);
+	free(task_pool);
 }
 
 int main(int argc, char* argv[])
@@ -379,7 +484,7 @@ int main(int argc, char* argv[])
 		fclose(file1);
 		fclose(file2);
 	} else
-		worker_func(rank);
+		add_limbs(rank, NULL, NULL, 0, NULL, NULL, NULL);
 
 	MPI_Finalize();
 	return 0;
@@ -5,186 +5,243 @@
 #include <mpi.h>
 #include <math.h>
 #include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <ctype.h>
+
+#include "bignum.h"
+
+// Number of digits of a term with whitespace around it is shorter
+#define HEADER_LEN 64
 
 int MPI_SIZE = 0;
+// Workers ordered from the least significant block to the most
+// significant one, i.e. in reverse order of their ranks
+MPI_Comm WORKERS_COMM = MPI_COMM_NULL;
 
 typedef struct {
 	int begin, end;
 } range_s;
 
+// File with number of digits of a term followed by the digits in one line,
+// so that each worker reads its own digits at known offset
+typedef struct {
+	MPI_File file;
+	// Number of digits and offset of the first one
+	MPI_Offset size, offset;
+} term_s;
+
 void graceful_abort(int signum)
 {
 	fprintf(stderr, "ERROR");
 	MPI_Abort(MPI_COMM_WORLD, 1);
 }
 
-void add_one(int* arr, int size)
+void add_one(uint64_t* arr, int size)
 {
-	int carry = 1;
 	for (int i = size - 1; i >= 0; i--) {
-		arr[i] += carry;
-		carry = arr[i] > 999999999;
-		arr[i] %= 1000000000;
+		if (++arr[i] < BIGNUM_DECIMAL_BASE)
+			break;
+		arr[i] = 0;
 	}
 }
 
-// It is responsibility of the caller to free result
-int* sum_block(int* term1, int* term2, int size, int rank) {
-	assert((rank <= MPI_SIZE - 1) && (rank >= 1));
-	assert(size > 0);
+// Opens file of a term and reads its header. Collective.
+void open_term(term_s* term, const char* file_name)
+{
+	int ret = MPI_File_open(MPI_COMM_WORLD, file_name, MPI_MODE_RDONLY,
+	                        MPI_INFO_NULL, &term->file);
+	assert(ret == MPI_SUCCESS);
+
+	char header[HEADER_LEN + 1];
+	MPI_Status status;
+	MPI_File_read_at(term->file, 0, header, HEADER_LEN, MPI_CHAR, &status);
+	int len = 0;
+	MPI_Get_count(&status, MPI_CHAR, &len);
+	header[len] = '\0';
+
+	char* ptr = header;
+	term->size = strtoll(header, &ptr, 10);
+	assert((ptr != header) && (term->size >= 0));
+	while ((ptr != header + len) && isspace((unsigned char)*ptr))
+		ptr++;
+	term->offset = ptr - header;
+}
 
-	// We only speculate if we can not constrain
-	// effect of carry from less significant digits
-	int will_speculate = (rank != MPI_SIZE - 1) &&
-	                     (term1[size-1] + term2[size-1] == 999999999);
-#ifdef DEBUG_PRINT
-	if (will_speculate)
-		fprintf(stderr, "%d: will speculate\n", rank);
-#endif
+// Reads digits [begin, end) of the term padded
+// with leading zeros to padded_size digits
+void read_digits(const term_s* term, MPI_Offset padded_size,
+                 MPI_Offset begin, MPI_Offset end, char* digits)
+{
+	MPI_Offset first = padded_size - term->size;
+	MPI_Offset from = (begin > first) ? begin : first;
+	if (from >= end) {
+		memset(digits, '0', end - begin);
+		return;
+	}
+	memset(digits, '0', from - begin);
+	assert(end - from <= INT_MAX);
+	MPI_File_read_at(term->file, term->offset + from - first, digits + (from - begin),
+	                 (int)(end - from), MPI_CHAR, MPI_STATUS_IGNORE);
+}
+
+// Header of the file with the sum, returns its length
+int sum_header(char header[HEADER_LEN], MPI_Offset digits_num)
+{
+	return snprintf(header, HEADER_LEN, "%lld\n", (long long)digits_num);
+}
+
+// Number of limbs of the longer term, the shorter one is
+// padded with leading zeros to the same number of limbs
+int sum_limbs(const term_s* term1, const term_s* term2)
+{
+	MPI_Offset max_size = (term1->size > term2->size) ? term1->size : term2->size;
+	return (int)((max_size + BIGNUM_DECIMAL_DIGITS - 1) / BIGNUM_DECIMAL_DIGITS);
+}
 
-	int* result1 = (int*)malloc(size * sizeof(int));
-	assert(result1);
+// Limbs of a worker, the most significant ones belong to rank 1
+range_s worker_range(int rank, int limbs_num)
+{
+	int workers_num = MPI_SIZE - 1;
+	range_s range;
+	range.begin = (int)((long long)limbs_num * (rank - 1) / workers_num);
+	range.end   = (int)((long long)limbs_num * rank / workers_num);
+	return range;
+}
 
-	int* result2;
-	if (will_speculate) {
-		result2 = (int*)malloc(size * sizeof(int));
-		assert(result2);
+// Carry out of a block as a function of carry into it:
+// carry_out = generate | (propagate & carry_in)
+typedef struct {
+	int generate, propagate;
+} carry_s;
+
+// Combines carry of less significant blocks(in) with carry of more
+// significant block(inout), scan goes from the least significant one
+void combine_carries(void* in, void* inout, int* len, MPI_Datatype* type)
+{
+	carry_s* lower = (carry_s*)in;
+	carry_s* upper = (carry_s*)inout;
+	for (int i = 0; i < *len; i++) {
+		upper[i].generate |= upper[i].propagate & lower[i].generate;
+		upper[i].propagate &= lower[i].propagate;
 	}
+}
 
-	int carry1 = 0, carry2 = 1;
+// It is responsibility of the caller to free result
+uint64_t* sum_block(uint64_t* term1, uint64_t* term2, int size, int rank) {
+	assert((rank <= MPI_SIZE - 1) && (rank >= 1));
+	assert(size >= 0);
 
-	for (int i = size - 1; i >= 0; i--) {
+	uint64_t* result = (uint64_t*)malloc((size + 1) * sizeof(uint64_t));
+	assert(result);
 
-		result1[i] = term1[i] + term2[i] + carry1;
-		carry1 = result1[i] > 999999999;
-		result1[i] %= 1000000000;
+	int carry = bignum_add_decimal(result, term1, term2, size, 0);
+	int all_nines = 1;
+	for (int i = 0; i < size; i++) {
+		all_nines &= (result[i] == BIGNUM_DECIMAL_BASE - 1);
 #ifdef DEBUG_PRINT
-		fprintf(stderr, "%d: sum = %09d\n", rank, result1[i]);
+		fprintf(stderr, "%d: sum = %018" PRIu64 "\n", rank, result[i]);
 #endif
-		if (will_speculate) {
-			result2[i] = term1[i] + term2[i] + carry2;
-			carry2 = result2[i] > 999999999;
-			result2[i] %= 1000000000;
-		}
 	}
 
-	int carry_in = 0;
-	int* result = result1;
-	int carry_out = carry1;
-
-	if (rank != MPI_SIZE - 1) {
-		MPI_Recv(&carry_in, 1, MPI_INT, rank + 1, 0, MPI_COMM_WORLD, NULL);
-
-		if ((carry_in == 1) && (will_speculate)) {
-			result = result2;
-			free(result1); result1 = NULL;
-			carry_out = carry2;
-		} else {
-			if (carry_in == 1)
-				add_one(result1, size);
-
-			result = result1;
-			free(result2); result2 = NULL;
-			carry_out = carry1;
-		}
-	}
+	// Instead of waiting for carry from each less significant
+	// block in turn, carries of all blocks are combined by
+	// parallel prefix in log(workers) steps
+	carry_s block_carry = {carry, all_nines};
+	carry_s lower_carry = {0, 0};
+	MPI_Datatype carry_type;
+	MPI_Type_contiguous(2, MPI_INT, &carry_type);
+	MPI_Type_commit(&carry_type);
+	MPI_Op carry_op;
+	MPI_Op_create(&combine_carries, 0, &carry_op);
+	MPI_Exscan(&block_carry, &lower_carry, 1, carry_type, carry_op, WORKERS_COMM);
+	MPI_Op_free(&carry_op);
+	MPI_Type_free(&carry_type);
+
+	// The least significant block gets nothing from the scan
+	int carry_in = (rank != MPI_SIZE - 1) && lower_carry.generate;
+	if (carry_in == 1)
+		add_one(result, size);
+	int carry_out = block_carry.generate | (block_carry.propagate & carry_in);
 
 #ifdef DEBUG_PRINT
 	fprintf(stderr, "%d: carry_out = %d\n", rank, carry_out);
 #endif
 	assert(carry_out == 1 || carry_out == 0);
-	MPI_Send(&carry_out, 1, MPI_INT, rank - 1, 0, MPI_COMM_WORLD);
+	// Root needs carry out of the most significant block only
+	if (rank == 1)
+		MPI_Send(&carry_out, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
 	return result;
 }
 
-void worker_func(int rank)
+void worker_func(int rank, term_s* term1_file, term_s* term2_file, MPI_File sum_file)
 {
-	range_s range;
-	MPI_Recv(&range, sizeof(range)/sizeof(int), MPI_INT, 0, 0, MPI_COMM_WORLD, NULL);
-
+	int limbs_num = sum_limbs(term1_file, term2_file);
+	MPI_Offset padded_size = (MPI_Offset)limbs_num * BIGNUM_DECIMAL_DIGITS;
+	range_s range = worker_range(rank, limbs_num);
 	int size = range.end - range.begin;
+	MPI_Offset begin = (MPI_Offset)range.begin * BIGNUM_DECIMAL_DIGITS;
+	MPI_Offset end   = (MPI_Offset)range.end * BIGNUM_DECIMAL_DIGITS;
 
-	int* term1 = (int*)malloc(size * sizeof(term1[0]));
+	char* digits = (char*)malloc(end - begin + 1);
+	assert(digits);
+	uint64_t* term1 = (uint64_t*)malloc((size + 1) * sizeof(term1[0]));
 	assert(term1);
-	int* term2 = (int*)malloc(size * sizeof(term2[0]));
+	uint64_t* term2 = (uint64_t*)malloc((size + 1) * sizeof(term2[0]));
 	assert(term2);
 
-	MPI_Recv(term1, size, MPI_INT, 0, 0, MPI_COMM_WORLD, NULL);
-	MPI_Recv(term2, size, MPI_INT, 0, 0, MPI_COMM_WORLD, NULL);
+	// Digits have to follow the header in one line
+	read_digits(term1_file, padded_size, begin, end, digits);
+	int ret = bignum_parse_decimal(term1, size, digits);
+	assert(ret == 0);
+	read_digits(term2_file, padded_size, begin, end, digits);
+	ret = bignum_parse_decimal(term2, size, digits);
+	assert(ret == 0);
 
 #ifdef DEBUG_PRINT
 	fprintf(stderr, "%d: term1 = ", rank);
 	for (int i = 0; i < size; i++) {
-		fprintf(stderr, "%09d", term1[i]);
+		fprintf(stderr, "%018" PRIu64, term1[i]);
 	}
 	fprintf(stderr, "\n%d: term2 = ", rank);
 	for (int i = 0; i < size; i++) {
-		fprintf(stderr, "%09d", term2[i]);
+		fprintf(stderr, "%018" PRIu64, term2[i]);
 	}
 	fprintf(stderr, "\n");
 #endif
 
 	// It is our responsibility to free result
-	int* result = sum_block(term1, term2, size, rank);
-
-	MPI_Send(&size, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-	MPI_Send(result, size, MPI_INT, 0, 0, MPI_COMM_WORLD);
+	uint64_t* result = sum_block(term1, term2, size, rank);
+	bignum_format_decimal(digits, result, size);
+
+	int digits_num = (int)(end - begin);
+	if (sum_file != MPI_FILE_NULL) {
+		// Carry digit of root goes after the header
+		char header[HEADER_LEN];
+		int header_len = sum_header(header, padded_size + 1);
+		MPI_File_write_at(sum_file, header_len + 1 + begin, digits, digits_num,
+		                  MPI_CHAR, MPI_STATUS_IGNORE);
+		MPI_Barrier(MPI_COMM_WORLD);
+	} else {
+		MPI_Send(&digits_num, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+		MPI_Send(digits, digits_num, MPI_CHAR, 0, 0, MPI_COMM_WORLD);
+	}
 
 	free(result);
 	free(term1);
 	free(term2);
+	free(digits);
 }
 
-void root_func(FILE* file1, FILE* file2)
+void root_func(term_s* term1_file, term_s* term2_file, MPI_File sum_file)
 {
-	int r = 0;
-	int rank = 0;
-	int size1, size2;
-
-	fscanf(file1, "%d ", &size1);
-	fscanf(file2, "%d ", &size2);
-
-	int array_size = (size1 > size2) ? size1 : size2;
-	array_size = (array_size % 9) ? array_size / 9 + 1 : array_size / 9;
-#ifdef DEBUG_PRINT
-	fprintf(stderr, "ROOT: size1 = %d, size2 = %d\n", size1, size2);
-#endif
-
-	int* array1 = (int*)malloc(array_size * sizeof(array1[0]));
-	assert(array1);
-	int* array2 = (int*)malloc(array_size * sizeof(array2[0]));
-	assert(array2);
-
-	int i = 0;
-	while (fscanf(file1, "%9d", &array1[i++]) == 1);
-
-	i = 0;
-	while (fscanf(file2, "%9d", &array2[i++]) == 1);
-
-	int workers_num = MPI_SIZE - 1;
-	int work_quota = array_size / workers_num;
-	if (work_quota == 0) {
-		fprintf(stderr, "Too many processes for current task\n");
-		assert(array_size > workers_num);
-	}
+	int limbs_num = sum_limbs(term1_file, term2_file);
+	MPI_Offset padded_size = (MPI_Offset)limbs_num * BIGNUM_DECIMAL_DIGITS;
 #ifdef DEBUG_PRINT
-	fprintf(stderr, "arr_size = %d, work_num = %d, quota = %d\n", array_size, workers_num, work_quota);
+	fprintf(stderr, "ROOT: size1 = %lld, size2 = %lld, limbs_num = %d\n",
+	        (long long)term1_file->size, (long long)term2_file->size, limbs_num);
 #endif
 	double start = MPI_Wtime();
-	for (int i = MPI_SIZE - 1; i >= 1; i--) {
-		range_s range;
-		range.begin = work_quota * (i - 1);
-		range.end   = range.begin + work_quota;
-#ifdef DEBUG_PRINT
-		fprintf(stderr, "%d:%d\n", range.begin, range.end);
-#endif
-
-		// Send info about amount of work to do
-		MPI_Send(&range, sizeof(range)/sizeof(int), MPI_INT, i, 0, MPI_COMM_WORLD);
-		// Send input for the work
-		MPI_Send(array1 + range.begin, work_quota, MPI_INT, i, 0, MPI_COMM_WORLD);
-		MPI_Send(array2 + range.begin, work_quota, MPI_INT, i, 0, MPI_COMM_WORLD);
-	}
 
 	int carry = 0;
 	MPI_Recv(&carry, 1, MPI_INT, 1, 0, MPI_COMM_WORLD, NULL);
@@ -193,36 +250,43 @@ void root_func(FILE* file1, FILE* file2)
 #endif
 	assert(carry == 0 || carry == 1);
 
-	int* result = (int*)malloc(array_size * sizeof(int));
+	if (sum_file != MPI_FILE_NULL) {
+		// Sum in the format of terms with carry as its first digit
+		char header[HEADER_LEN + 1];
+		int header_len = sum_header(header, padded_size + 1);
+		header[header_len] = carry ? '1' : '0';
+		MPI_File_write_at(sum_file, 0, header, header_len + 1, MPI_CHAR, MPI_STATUS_IGNORE);
+		MPI_File_write_at(sum_file, header_len + 1 + padded_size, "\n", 1,
+		                  MPI_CHAR, MPI_STATUS_IGNORE);
+		// Workers have written their digits
+		MPI_Barrier(MPI_COMM_WORLD);
+		printf("Time elapsed: %lg\n", MPI_Wtime() - start);
+		fflush(stdout);
+		return;
+	}
+
+	// Carry is the most significant digit of the sum
+	char* result = (char*)malloc(padded_size + 2);
 	assert(result);
+	result[0] = carry ? '1' : '0';
 
 	int work_completed = 0;
-	int* ptr = result;
+	char* ptr = result + 1;
 	for (int i = 1; i < MPI_SIZE; ptr += work_completed, i++) {
 		MPI_Recv(&work_completed, 1, MPI_INT, i, 0, MPI_COMM_WORLD, NULL);
-		MPI_Recv(ptr, work_completed, MPI_INT, i, 0, MPI_COMM_WORLD, NULL);
+		MPI_Recv(ptr, work_completed, MPI_CHAR, i, 0, MPI_COMM_WORLD, NULL);
 	}
-	assert(ptr == result + array_size);
+	assert(ptr == result + 1 + padded_size);
 
-#ifdef DEBUG_PRINT
-	printf("     %s", carry ? " " : "");
-	for (int i = 0; i < array_size; i++)
-		printf("%09d", array1[i]);
-	printf("\n  +\n");
-	printf("     %s", carry ? " " : "");
-	for (int i = 0; i < array_size; i++)
-		printf("%09d", array2[i]);
-	printf("\n");
-#endif
-	printf("Sum: %s", carry ? "1" : "");
-	for (int i = 0; i < array_size; i++)
-		printf("%09d", result[i]);
+	MPI_Offset zeros = 0;
+	while ((zeros < padded_size) && (result[zeros] == '0'))
+		zeros++;
+	fputs("Sum: ", stdout);
+	fwrite(result + zeros, 1, padded_size + 1 - zeros, stdout);
 	printf("\nTime elapsed: %lg\n", MPI_Wtime() - start);
 	fflush(stdout);
 
 	free(result);
-	free(array1);
-	free(array2);
 }
 
 int main(int argc, char* argv[])
@@ -230,8 +294,8 @@ int main(int argc, char* argv[])
 	signal(SIGABRT, &graceful_abort);
 
 	MPI_Init(&argc, &argv);
-	if (argc != 3) {
-		fprintf(stderr, "usage: %s file_with_number1 file_with_number2\n", argv[0]);
+	if ((argc != 3) && (argc != 4)) {
+		fprintf(stderr, "usage: %s file_with_number1 file_with_number2 [file_for_sum]\n", argv[0]);
 		return 1;
 	}
 
@@ -240,19 +304,34 @@ int main(int argc, char* argv[])
 
 	MPI_Comm_size(MPI_COMM_WORLD, &MPI_SIZE);
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_Comm_split(MPI_COMM_WORLD, (rank == 0) ? MPI_UNDEFINED : 0,
+	               MPI_SIZE - rank, &WORKERS_COMM);
+
+	// Every worker reads and writes its own digits
+	term_s term1, term2;
+	open_term(&term1, argv[1]);
+	open_term(&term2, argv[2]);
+	MPI_File sum_file = MPI_FILE_NULL;
+	if (argc == 4) {
+		int ret = MPI_File_open(MPI_COMM_WORLD, argv[3], MPI_MODE_CREATE | MPI_MODE_WRONLY,
+		                        MPI_INFO_NULL, &sum_file);
+		assert(ret == MPI_SUCCESS);
+		MPI_Offset padded_size = (MPI_Offset)sum_limbs(&term1, &term2) * BIGNUM_DECIMAL_DIGITS;
+		char header[HEADER_LEN];
+		MPI_File_set_size(sum_file, sum_header(header, padded_size + 1) + padded_size + 2);
+	}
 
 	if (rank == 0) {
-		FILE* file1 = fopen(argv[1], "r");
-		assert(file1);
-		FILE* file2 = fopen(argv[2], "r");
-		assert(file2);
-
-		root_func(file1, file2);
+		root_func(&term1, &term2, sum_file);
+	} else {
+		worker_func(rank, &term1, &term2, sum_file);
+		MPI_Comm_free(&WORKERS_COMM);
+	}
 
-		fclose(file1);
-		fclose(file2);
-	} else
-		worker_func(rank);
+	if (sum_file != MPI_FILE_NULL)
+		MPI_File_close(&sum_file);
+	MPI_File_close(&term1.file);
+	MPI_File_close(&term2.file);
 
 	MPI_Finalize();
 	return 0;
@@ -0,0 +1,71 @@
+#!/bin/bash
+# Runs the same random soup with each number of workers on each
+# arena size in benchmark mode and plots cells per second.
+# Sizes, numbers of workers and extra mpirun options may be
+# overridden with SIZES, WORKERS and MPIRUN_FLAGS.
+GENERATIONS=${1:-1000}
+DENSITY=${2:-0.3}
+SEED=1
+SIZES=${SIZES:-"512 1024 2048 4096"}
+WORKERS=${WORKERS:-"1 2 4 8"}
+
+if [ "$1" == "-h" ]
+then
+	echo "Usage: ./bench.sh [generations] [density]"
+	echo "Example: SIZES=\"256 512\" WORKERS=\"1 2\" ./bench.sh 100 0.5"
+	exit
+fi
+
+echo "Making main"
+make main > /dev/null
+if [ $? != 0 ]
+then
+	echo "Failed to make main"
+	exit
+fi
+
+mkdir build/ 2> /dev/null
+echo "# workers width height generations time_s cells_per_second population checksum" > build/plot.dat
+for size in $SIZES
+do
+	for workers in $WORKERS
+	do
+		echo "Running $workers workers on ${size}x${size}"
+		mpirun -n $(($workers + 1)) $MPIRUN_FLAGS ./main -w $size -h $size \
+		       -i $GENERATIONS -r $GENERATIONS -d $DENSITY -S $SEED -B >> build/plot.dat
+		if [[ $? != 0 ]]
+		then
+			echo "./main failed on ${size}x${size} with $workers workers, aborting"
+			exit
+		fi
+	done
+	# Blank lines separate data sets of gnuplot
+	printf "\n\n" >> build/plot.dat
+done
+
+# All runs on the same arena have to end with the same cells
+awk '!/^#/ && NF { key = $2 "x" $3
+                   if (key in sums && sums[key] != $8)
+                       print "Checksum mismatch on " key " with " $1 " workers"
+                   sums[key] = $8 }' build/plot.dat
+
+echo "Plotting cells per second"
+mkdir res/ 2> /dev/null
+SETS=$(echo $SIZES | wc -w)
+gnuplot <<< "set term png size 1920,1080; \
+             set output 'res/bench.png'; \
+             set xlabel 'workers'; \
+             set ylabel 'cells per second'; \
+             set logscale x 2; \
+             plot for [i=0:$SETS-1] 'build/plot.dat' index i u 1:6 \
+                  title word('$SIZES', i+1).'^2' w linespoints"
+
+gnuplot <<< "set term dumb size `tput cols`,`tput lines`; \
+             set logscale x 2; \
+             plot for [i=0:$SETS-1] 'build/plot.dat' index i u 1:6 \
+                  title word('$SIZES', i+1).'^2' w linespoints"
+
+FILENAME="plot_data/bench_`date "+%s"`.dat"
+echo "Saving plot data in $FILENAME"
+mkdir plot_data/ 2> /dev/null
+cp build/plot.dat $FILENAME
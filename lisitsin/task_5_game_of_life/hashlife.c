@@ -0,0 +1,437 @@
+#include "hashlife.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+static size_t hash(const hl_node_s* nw, const hl_node_s* ne,
+                   const hl_node_s* sw, const hl_node_s* se)
+{
+	uint64_t h = (uint64_t)(uintptr_t)nw;
+	h = h * 0x9E3779B97F4A7C15ull + (uint64_t)(uintptr_t)ne;
+	h = h * 0x9E3779B97F4A7C15ull + (uint64_t)(uintptr_t)sw;
+	h = h * 0x9E3779B97F4A7C15ull + (uint64_t)(uintptr_t)se;
+	return (size_t)(h ^ (h >> 29));
+}
+
+static hl_node_s* alloc_node(hl_universe_s* u)
+{
+	if (u->free_list == NULL) {
+		struct hl_chunk* chunk = (struct hl_chunk*)malloc(sizeof(struct hl_chunk));
+		assert(chunk);
+		chunk->next = u->chunks;
+		u->chunks = chunk;
+		for (int i = 0; i < HL_CHUNK_NODES; i++) {
+			chunk->nodes[i].next = u->free_list;
+			u->free_list = &chunk->nodes[i];
+		}
+	}
+	hl_node_s* node = u->free_list;
+	u->free_list = node->next;
+	return node;
+}
+
+static void resize_table(hl_universe_s* u, size_t new_size)
+{
+	hl_node_s** table = (hl_node_s**)calloc(new_size, sizeof(hl_node_s*));
+	assert(table);
+	for (size_t i = 0; i < u->table_size; i++) {
+		hl_node_s* node = u->table[i];
+		while (node) {
+			hl_node_s* next = node->next;
+			size_t h = hash(node->nw, node->ne, node->sw, node->se) & (new_size - 1);
+			node->next = table[h];
+			table[h] = node;
+			node = next;
+		}
+	}
+	free(u->table);
+	u->table = table;
+	u->table_size = new_size;
+}
+
+// Returns the only node with given children
+static hl_node_s* find_node(hl_universe_s* u, hl_node_s* nw, hl_node_s* ne,
+                            hl_node_s* sw, hl_node_s* se)
+{
+	size_t h = hash(nw, ne, sw, se) & (u->table_size - 1);
+	for (hl_node_s* node = u->table[h]; node; node = node->next) {
+		if ((node->nw == nw) && (node->ne == ne) &&
+		    (node->sw == sw) && (node->se == se))
+			return node;
+	}
+
+	hl_node_s* node = alloc_node(u);
+	node->nw = nw;
+	node->ne = ne;
+	node->sw = sw;
+	node->se = se;
+	node->result = NULL;
+	node->step_result = NULL;
+	node->population = nw->population + ne->population +
+	                   sw->population + se->population;
+	node->level = nw->level + 1;
+	node->step = -1;
+	node->marked = 0;
+	node->next = u->table[h];
+	u->table[h] = node;
+
+	if (++u->nodes_num > u->table_size)
+		resize_table(u, u->table_size * 2);
+	return node;
+}
+
+static hl_node_s* empty_node(hl_universe_s* u, int level)
+{
+	if (u->empty[level] == NULL) {
+		hl_node_s* child = empty_node(u, level - 1);
+		u->empty[level] = find_node(u, child, child, child, child);
+	}
+	return u->empty[level];
+}
+
+void hl_init(hl_universe_s* u, size_t max_nodes)
+{
+	memset(u, 0, sizeof(*u));
+	u->max_nodes = max_nodes;
+	u->birth = 1u << 3;
+	u->survival = (1u << 2) | (1u << 3);
+	u->table_size = 1 << 16;
+	u->table = (hl_node_s**)calloc(u->table_size, sizeof(hl_node_s*));
+	assert(u->table);
+
+	// Leaves are never collected
+	for (int i = 0; i < 2; i++) {
+		u->leaves[i].population = i;
+		u->leaves[i].marked = 1;
+	}
+	u->empty[0] = &u->leaves[0];
+	u->root = empty_node(u, 3);
+}
+
+void hl_destroy(hl_universe_s* u)
+{
+	while (u->chunks) {
+		struct hl_chunk* next = u->chunks->next;
+		free(u->chunks);
+		u->chunks = next;
+	}
+	free(u->table);
+}
+
+void hl_set_rule(hl_universe_s* u, unsigned birth, unsigned survival)
+{
+	assert(!(birth & 1) && (u->generation == 0));
+	u->birth = birth;
+	u->survival = survival;
+}
+
+// Same node with the old one in the center
+static hl_node_s* expand(hl_universe_s* u, hl_node_s* node)
+{
+	assert(node->level < HL_MAX_LEVEL);
+	hl_node_s* e = empty_node(u, node->level - 1);
+	int64_t shift = (int64_t)1 << (node->level - 1);
+	if (node == u->root) {
+		u->x -= shift;
+		u->y -= shift;
+	}
+	return find_node(u, find_node(u, e, e, e, node->nw),
+	                    find_node(u, e, e, node->ne, e),
+	                    find_node(u, e, node->sw, e, e),
+	                    find_node(u, node->se, e, e, e));
+}
+
+static hl_node_s* set_cell(hl_universe_s* u, hl_node_s* node, int64_t x, int64_t y)
+{
+	if (node->level == 0)
+		return &u->leaves[1];
+	int64_t half = (int64_t)1 << (node->level - 1);
+	hl_node_s* nw = node->nw;
+	hl_node_s* ne = node->ne;
+	hl_node_s* sw = node->sw;
+	hl_node_s* se = node->se;
+	if (y < half) {
+		if (x < half)
+			nw = set_cell(u, nw, x, y);
+		else
+			ne = set_cell(u, ne, x - half, y);
+	} else {
+		if (x < half)
+			sw = set_cell(u, sw, x, y - half);
+		else
+			se = set_cell(u, se, x - half, y - half);
+	}
+	return find_node(u, nw, ne, sw, se);
+}
+
+hl_node_s* hl_node(hl_universe_s* u, hl_node_s* nw, hl_node_s* ne,
+                   hl_node_s* sw, hl_node_s* se)
+{
+	assert((nw->level == ne->level) && (nw->level == sw->level) &&
+	       (nw->level == se->level) && (nw->level < HL_MAX_LEVEL));
+	return find_node(u, nw, ne, sw, se);
+}
+
+hl_node_s* hl_leaf(hl_universe_s* u, int alive)
+{
+	return &u->leaves[alive != 0];
+}
+
+hl_node_s* hl_empty(hl_universe_s* u, int level)
+{
+	assert((level >= 0) && (level <= HL_MAX_LEVEL));
+	return empty_node(u, level);
+}
+
+void hl_set_cell(hl_universe_s* u, int64_t x, int64_t y)
+{
+	while (1) {
+		int64_t size = (int64_t)1 << u->root->level;
+		if ((x >= u->x) && (x - u->x < size) && (y >= u->y) && (y - u->y < size))
+			break;
+		u->root = expand(u, u->root);
+	}
+	u->root = set_cell(u, u->root, x - u->x, y - u->y);
+}
+
+static hl_node_s* center(hl_universe_s* u, const hl_node_s* node)
+{
+	return find_node(u, node->nw->se, node->ne->sw, node->sw->ne, node->se->nw);
+}
+
+// Cell (i, j) of 4x4 node
+static int cell(const hl_node_s* node, int i, int j)
+{
+	const hl_node_s* quad = (i < 2) ? ((j < 2) ? node->nw : node->ne)
+	                                : ((j < 2) ? node->sw : node->se);
+	i &= 1;
+	j &= 1;
+	const hl_node_s* leaf = (i == 0) ? ((j == 0) ? quad->nw : quad->ne)
+	                                 : ((j == 0) ? quad->sw : quad->se);
+	return (int)leaf->population;
+}
+
+// Center 2x2 of 4x4 node after one generation
+static hl_node_s* base_result(hl_universe_s* u, const hl_node_s* node)
+{
+	hl_node_s* res[2][2];
+	for (int i = 1; i <= 2; i++) {
+		for (int j = 1; j <= 2; j++) {
+			int neighbors = 0;
+			for (int di = -1; di <= 1; di++)
+				for (int dj = -1; dj <= 1; dj++)
+					if (di || dj)
+						neighbors += cell(node, i + di, j + dj);
+			unsigned rule = cell(node, i, j) ? u->survival : u->birth;
+			int alive = (rule >> neighbors) & 1;
+			res[i - 1][j - 1] = &u->leaves[alive];
+		}
+	}
+	return find_node(u, res[0][0], res[0][1], res[1][0], res[1][1]);
+}
+
+// Center of the node(one level lower) after 2^step generations,
+// step <= level-2. Outside of the node the plane is considered empty.
+static hl_node_s* advance(hl_universe_s* u, hl_node_s* node, int step)
+{
+	int level = node->level;
+	assert(step <= level - 2);
+	if (node->population == 0)
+		return empty_node(u, level - 1);
+	if (level == 2)
+		return base_result(u, node);
+	int full_speed = (step == level - 2);
+	if (full_speed && node->result)
+		return node->result;
+	if (!full_speed && node->step_result && (node->step == step))
+		return node->step_result;
+
+	// 3x3 overlapping subnodes of half size
+	hl_node_s* sub[3][3] = {
+		{node->nw,
+		 find_node(u, node->nw->ne, node->ne->nw, node->nw->se, node->ne->sw),
+		 node->ne},
+		{find_node(u, node->nw->sw, node->nw->se, node->sw->nw, node->sw->ne),
+		 center(u, node),
+		 find_node(u, node->ne->sw, node->ne->se, node->se->nw, node->se->ne)},
+		{node->sw,
+		 find_node(u, node->sw->ne, node->se->nw, node->sw->se, node->se->sw),
+		 node->se},
+	};
+	// Either advanced by half of the step or not advanced at all
+	int sub_step = full_speed ? step - 1 : step;
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			sub[i][j] = full_speed ? advance(u, sub[i][j], sub_step)
+			                       : center(u, sub[i][j]);
+
+	hl_node_s* quads[2][2];
+	for (int i = 0; i < 2; i++)
+		for (int j = 0; j < 2; j++)
+			quads[i][j] = advance(u, find_node(u, sub[i][j],     sub[i][j + 1],
+			                                      sub[i + 1][j], sub[i + 1][j + 1]),
+			                      sub_step);
+	hl_node_s* res = find_node(u, quads[0][0], quads[0][1], quads[1][0], quads[1][1]);
+
+	if (full_speed) {
+		node->result = res;
+	} else {
+		node->step_result = res;
+		node->step = step;
+	}
+	return res;
+}
+
+// Whether all live cells are inside the central quarter(by side) of root,
+// so that they can not leave the result of advance by 2^(level-3)
+static int is_padded(const hl_node_s* node)
+{
+	return (node->level >= 3) &&
+	       (node->nw->se->se->population + node->ne->sw->sw->population +
+	        node->sw->ne->ne->population + node->se->nw->nw->population ==
+	        node->population);
+}
+
+int hl_advance(hl_universe_s* u, uint64_t generations)
+{
+	for (int step = 0; generations != 0; step++, generations >>= 1) {
+		if ((generations & 1) == 0)
+			continue;
+		while ((u->root->level < step + 3) || !is_padded(u->root)) {
+			if (u->root->level == HL_MAX_LEVEL)
+				return 1;
+			u->root = expand(u, u->root);
+		}
+		int64_t shift = (int64_t)1 << (u->root->level - 2);
+		u->root = advance(u, u->root, step);
+		u->x += shift;
+		u->y += shift;
+		u->generation += (uint64_t)1 << step;
+
+		if (u->nodes_num > u->max_nodes)
+			hl_collect(u);
+	}
+	return 0;
+}
+
+static void mark(hl_node_s* node)
+{
+	if (node->marked)
+		return;
+	node->marked = 1;
+	mark(node->nw);
+	mark(node->ne);
+	mark(node->sw);
+	mark(node->se);
+}
+
+void hl_collect(hl_universe_s* u)
+{
+	mark(u->root);
+	for (int i = 0; i <= HL_MAX_LEVEL; i++)
+		if (u->empty[i])
+			mark(u->empty[i]);
+
+	// Forget results which are going to be freed
+	for (size_t i = 0; i < u->table_size; i++) {
+		for (hl_node_s* node = u->table[i]; node; node = node->next) {
+			if (!node->marked)
+				continue;
+			if (node->result && !node->result->marked)
+				node->result = NULL;
+			if (node->step_result && !node->step_result->marked)
+				node->step_result = NULL;
+		}
+	}
+
+	for (size_t i = 0; i < u->table_size; i++) {
+		hl_node_s** link = &u->table[i];
+		while (*link) {
+			hl_node_s* node = *link;
+			if (node->marked) {
+				node->marked = 0;
+				link = &node->next;
+			} else {
+				*link = node->next;
+				node->next = u->free_list;
+				u->free_list = node;
+				u->nodes_num--;
+			}
+		}
+	}
+	u->collections_num++;
+}
+
+uint64_t hl_population(const hl_universe_s* u)
+{
+	return u->root->population;
+}
+
+// Offset of the nearest(or farthest if far is set) line(or column if
+// vertical is not set) with live cells in nonempty node
+static int64_t edge(const hl_node_s* node, int vertical, int far)
+{
+	if (node->level == 0)
+		return 0;
+	int64_t half = (int64_t)1 << (node->level - 1);
+	const hl_node_s* halves[2][2] = {
+		{node->nw, vertical ? node->ne : node->sw},
+		{vertical ? node->sw : node->ne, node->se},
+	};
+	int h = far ? 1 : 0;
+	if (halves[h][0]->population + halves[h][1]->population == 0)
+		h ^= 1;
+	int64_t res = far ? -1 : INT64_MAX;
+	for (int i = 0; i < 2; i++) {
+		if (halves[h][i]->population == 0)
+			continue;
+		int64_t val = h * half + edge(halves[h][i], vertical, far);
+		if (far ? (val > res) : (val < res))
+			res = val;
+	}
+	return res;
+}
+
+int hl_bounding_box(const hl_universe_s* u, int64_t* x0, int64_t* y0,
+                    int64_t* x1, int64_t* y1)
+{
+	if (u->root->population == 0)
+		return 0;
+	*x0 = u->x + edge(u->root, 0, 0);
+	*x1 = u->x + edge(u->root, 0, 1);
+	*y0 = u->y + edge(u->root, 1, 0);
+	*y1 = u->y + edge(u->root, 1, 1);
+	return 1;
+}
+
+// Cells of nonempty node in its line y, from west to east
+static void for_each_in_line(const hl_node_s* node, int64_t x, int64_t y, int64_t line,
+                             void (*func)(void* ctx, int64_t x, int64_t y), void* ctx)
+{
+	if (node->level == 0) {
+		func(ctx, x, y + line);
+		return;
+	}
+	int64_t half = (int64_t)1 << (node->level - 1);
+	const hl_node_s* west = (line < half) ? node->nw : node->sw;
+	const hl_node_s* east = (line < half) ? node->ne : node->se;
+	if (line >= half) {
+		y += half;
+		line -= half;
+	}
+	if (west->population)
+		for_each_in_line(west, x, y, line, func, ctx);
+	if (east->population)
+		for_each_in_line(east, x + half, y, line, func, ctx);
+}
+
+void hl_for_each_cell(const hl_universe_s* u,
+                      void (*func)(void* ctx, int64_t x, int64_t y), void* ctx)
+{
+	int64_t x0, y0, x1, y1;
+	if (!hl_bounding_box(u, &x0, &y0, &x1, &y1))
+		return;
+	for (int64_t y = y0; y <= y1; y++)
+		for_each_in_line(u->root, u->x, u->y, y - u->y, func, ctx);
+}
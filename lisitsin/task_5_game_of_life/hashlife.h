@@ -0,0 +1,106 @@
+#ifndef HASHLIFE_H
+#define HASHLIFE_H
+
+// Gosper's Hashlife: the plane is a quadtree of canonical(shared)
+// nodes and the center of a node after 2^k generations is memoized
+// in the node itself, so repetitive patterns are stepped by huge
+// powers of two in time proportional to their description size.
+// Unlike workers' arena the plane is unbounded.
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Root never grows beyond this level, coordinates are kept in int64_t
+#define HL_MAX_LEVEL 60
+// Step of 2^k generations needs root of level k + 3 at least
+#define HL_MAX_GENERATIONS (((uint64_t)1 << (HL_MAX_LEVEL - 2)) - 1)
+
+#define HL_CHUNK_NODES 4096
+
+// Node of level L is a square of 2^L x 2^L cells, leaves are single cells
+struct hl_node {
+	struct hl_node* nw;
+	struct hl_node* ne;
+	struct hl_node* sw;
+	struct hl_node* se;
+	// Center of the node after 2^(level-2) generations
+	struct hl_node* result;
+	// Center of the node after 2^step generations, step < level-2
+	struct hl_node* step_result;
+	// Chain in the hash table or in the free list
+	struct hl_node* next;
+	uint64_t population;
+	int level;
+	int step;
+	int marked;
+};
+typedef struct hl_node hl_node_s;
+
+struct hl_chunk {
+	struct hl_chunk* next;
+	hl_node_s nodes[HL_CHUNK_NODES];
+};
+
+struct hl_universe {
+	hl_node_s* root;
+	// Bit n is set if dead(alive) cell with n neighbors
+	// is alive at the next generation, B3/S23 by default
+	unsigned birth, survival;
+	// Coordinates of the north-west corner of root
+	int64_t x, y;
+	uint64_t generation;
+
+	// Every node except leaves is stored in the table exactly once
+	hl_node_s** table;
+	size_t table_size;
+	size_t nodes_num;
+	// Unreachable nodes are collected when this is exceeded
+	size_t max_nodes;
+	size_t collections_num;
+
+	hl_node_s* free_list;
+	struct hl_chunk* chunks;
+	hl_node_s leaves[2];
+	hl_node_s* empty[HL_MAX_LEVEL + 1];
+};
+typedef struct hl_universe hl_universe_s;
+
+
+void hl_init(hl_universe_s* u, size_t max_nodes);
+
+void hl_destroy(hl_universe_s* u);
+
+// Has to be set before the first hl_advance, since results are memoized.
+// Empty space has to stay empty, so rules with B0 are not supported.
+void hl_set_rule(hl_universe_s* u, unsigned birth, unsigned survival);
+
+void hl_set_cell(hl_universe_s* u, int64_t x, int64_t y);
+
+// Canonical node with given children, leaf(alive or dead cell)
+// and empty node of given level. Used to load patterns which are
+// stored as quadtrees themselves.
+hl_node_s* hl_node(hl_universe_s* u, hl_node_s* nw, hl_node_s* ne,
+                   hl_node_s* sw, hl_node_s* se);
+hl_node_s* hl_leaf(hl_universe_s* u, int alive);
+hl_node_s* hl_empty(hl_universe_s* u, int level);
+
+// Generations are done as a series of power-of-two steps. Returns 0 on
+// success, 1 if root would grow beyond HL_MAX_LEVEL, then u->generation
+// tells how far the pattern has got.
+int hl_advance(hl_universe_s* u, uint64_t generations);
+
+// Frees nodes unreachable from root along with memoized results
+// pointing to them
+void hl_collect(hl_universe_s* u);
+
+uint64_t hl_population(const hl_universe_s* u);
+
+// Returns 0 if there are no live cells
+int hl_bounding_box(const hl_universe_s* u, int64_t* x0, int64_t* y0,
+                    int64_t* x1, int64_t* y1);
+
+// Calls func for every live cell, line after line
+void hl_for_each_cell(const hl_universe_s* u,
+                      void (*func)(void* ctx, int64_t x, int64_t y), void* ctx);
+
+#endif
@@ -7,47 +7,27 @@
 #include <mpi.h>
 #include <math.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "hashlife.h"
+#include "pattern.h"
+#include "profile.h"
 
-#define ARENA_FIGURES
 //#define DRAW_WITH_SDL
 
-//#define ARENA_GUN
-
-#ifdef ARENA_FIGURES
-#  define N 32
-#  undef DRAW_WITH_SDL
-#elif defined(ARENA_GUN)
-#  define SDL_SCALE 4.0f
-#  define N 228
-#  define RLE_FILE_NAME "gun_rle.txt"
-#elif defined(ARENA_PUFFER)
-#  define SDL_SCALE 1.0f
-#  define N 896
-#  define RLE_FILE_NAME "puffer_rle.txt"
-#elif defined(ARENA_LIFE_UNIT)
-#  define SDL_SCALE 2.0f
-#  define N 512
-#  define RLE_FILE_NAME "unit_rle.txt"
-#endif
+// Workers store one cell per char instead of
+// packing 64 cells into a machine word
+//#define CHAR_ARENA
 
 #ifdef DRAW_WITH_SDL
 #  include <SDL2/SDL.h>
 #endif
 
 #ifdef DRAW_WITH_SDL
-// This option tells how often
-// to fast-forward calculation
-// without drawing frame
-#  define ITERATIONS_PER_FRAME 1
-#else
-#  define ITERATIONS_PER_FRAME 1
-#endif
-
-#ifdef DRAW_WITH_SDL
-#  ifndef SDL_SCALE
-#    define SDL_SCALE 2.0f
-#  endif
 #  define SHOW_WORKERS_BORDERS
 #  define COLORED_CELLS
 #endif
@@ -59,24 +39,115 @@
 // to calculate FPS
 #define ITERATIONS_PER_FPS_UPDATE 50
 
-// N is dimension of game of life field.
-// N must be divisible by (MPI_SIZE-1)
-// in order to divide task evenly.
-// Also, to avoid mess with probabilities
-// and equidistribution better make it
-// power of 2.
-#ifndef N
-#  define N (32)
+// Lines are moved between rows of workers only if
+// the slowest row is this much slower than average
+#define BALANCE_THRESHOLD 1.1
+
+// Hashlife frees unreachable nodes when
+// there are more of them than this
+#define HASHLIFE_MAX_NODES (1 << 22)
+
+#ifdef CHAR_ARENA
+typedef unsigned char cell_t;
+#  define CELLS_PER_UNIT 1
+#  define MPI_CELL_T MPI_UNSIGNED_CHAR
+#else
+// Bit j of unit u keeps cell u*64+j of the line
+typedef uint64_t cell_t;
+#  define CELLS_PER_UNIT 64
+#  define MPI_CELL_T MPI_UINT64_T
+// Cells of the last unit of a line which lie inside of the arena
+#  define LAST_UNIT_MASK \
+	((WIDTH % 64) ? ((uint64_t)1 << (WIDTH % 64)) - 1 : ~(uint64_t)0)
+#endif
+
+// Number of cell_t units in one line of the arena
+#define ROW_UNITS ((WIDTH + CELLS_PER_UNIT - 1) / CELLS_PER_UNIT)
+
+// Dead units beyond halo on each side of the stored area. Whole
+// units of halo are calculated in packed arena, and their neighbors
+// are read without checking whether they exist.
+#ifdef CHAR_ARENA
+#  define PAD_UNITS 0
+#else
+#  define PAD_UNITS 1
 #endif
 
-#define ITER_NUM 100000
+// Owned area of a worker is divided into tiles of about 64x64
+// cells, tiles where nothing can change are not calculated
+#define TILE_LINES 64
+#define TILE_UNITS (64 / CELLS_PER_UNIT)
 
 int MPI_SIZE = 0;
 
+// Root and workers taking part in simulation. Ranks
+// beyond requested number of workers stay idle.
+MPI_Comm LIFE_COMM = MPI_COMM_NULL;
+int WORKERS_NUM = 0;
+// Workers form GRID[0] x GRID[1] cartesian grid, worker
+// number i(i = rank - 1) has coordinates (i / GRID[1], i % GRID[1])
+int GRID[2] = {0, 0};
+// Row i of the grid owns lines [LINE_BOUNDS[i], LINE_BOUNDS[i + 1]),
+// the table is kept by root and all workers
+int* LINE_BOUNDS = NULL;
+
+// Dimensions of game of life field
+int WIDTH  = 32;
+int HEIGHT = 32;
+int ITER_NUM = 100000;
+// This option tells how often root collects
+// arena state from workers in order to show it.
+// Workers do not wait for root in between.
+int ITERATIONS_PER_FRAME = 1;
+// Built-in glider and blinker are used if not set
+const char* RLE_FILE_NAME = NULL;
+// Random soup of cells alive with probability DENSITY is used
+// instead of pattern if it is set, the same for the same SEED
+double DENSITY = 0.0;
+uint64_t SEED = 1;
+// Nothing is shown, root prints simulation speed and
+// population with checksum of the arena when it ends
+int BENCHMARK = 0;
+// Workers keep HALO_DEPTH lines of halo and exchange it once per
+// HALO_DEPTH generations. Shrinking part of the halo is calculated
+// by both neighbors in between.
+int HALO_DEPTH = 1;
+// Hide halo exchange behind calculation of inner cells
+int OVERLAP_EXCHANGE = 0;
+// Lines and columns of the arena wrap around, otherwise
+// cells beyond the border are dead
+int TORUS = 0;
+// Threads calculating block of each worker
+int THREADS_NUM = 1;
+// Workers write their blocks into this file once per
+// CHECKPOINT_PERIOD iterations and when simulation ends
+const char* CHECKPOINT_FILE_NAME = NULL;
+int CHECKPOINT_PERIOD = INT_MAX;
+// Simulation is resumed from this checkpoint instead of pattern
+const char* RESTART_FILE_NAME = NULL;
+// Generation of the initial state
+uint64_t START_GENERATION = 0;
+// Rule given by -R, otherwise it is taken from the pattern
+// file or checkpoint, B3/S23 is used if it is not given there
+const char* RULE_STRING = NULL;
+rule_s RULE = {1u << 3, (1u << 2) | (1u << 3)};
+// Root alone jumps this many generations ahead with
+// Hashlife on unbounded plane instead of running workers
+uint64_t HASHLIFE_GENERATIONS = 0;
+// Root prints how long workers spent calculating and communicating,
+// and writes time of each of their activities into TRACE_FILE_NAME
+int PROFILE = 0;
+const char* TRACE_FILE_NAME = NULL;
+// Lines are redistributed among rows of workers according to
+// their calculation time once per BALANCE_PERIOD iterations
+int BALANCE_PERIOD = 0;
+#ifdef DRAW_WITH_SDL
+float SDL_SCALE = 2.0f;
+#endif
+
 enum {
 	COMMAND_CONTINUE = 0,
 	COMMAND_HALT,
-	COMMAND_CONTINUE_FAST_FORWARD,
 	COMMAND_INVALID,
 };
 
@@ -84,30 +155,257 @@ typedef struct {
 	int begin, end;
 } range_s;
 
+// Neighbors of a block, opposite directions differ in the lowest bit
+enum {
+	DIR_N = 0, DIR_S,
+	DIR_W,     DIR_E,
+	DIR_NW,    DIR_SE,
+	DIR_NE,    DIR_SW,
+	DIRECTIONS_NUM,
+};
+
+static const int DIR_OFFSET[DIRECTIONS_NUM][2] = {
+	[DIR_N]  = {-1,  0}, [DIR_S]  = {1,  0},
+	[DIR_W]  = { 0, -1}, [DIR_E]  = {0,  1},
+	[DIR_NW] = {-1, -1}, [DIR_SE] = {1,  1},
+	[DIR_NE] = {-1,  1}, [DIR_SW] = {1, -1},
+};
+
+// Part of the arena stored by a worker. Owned cells are
+// surrounded by halo_lines lines/halo_units units of halo and then
+// PAD_UNITS units on each side. Halo without neighbor, i.e. on the
+// border of bounded arena, is never written and keeps dead cells,
+// so neighbors of calculated cells are always stored.
+typedef struct {
+	MPI_Comm comm;
+	// Owned lines and units of the arena
+	range_s lines, units;
+	// Stored area and position of owned area inside of it
+	int lines_num, units_num;
+	int first_line, first_unit;
+	int halo_lines, halo_units;
+#ifndef CHAR_ARENA
+	// Cells of each stored unit which lie inside of the arena
+	cell_t* unit_masks;
+#endif
+	int neighbors[DIRECTIONS_NUM];
+	MPI_Datatype halo_types[DIRECTIONS_NUM];
+	MPI_Datatype owned_type;
+} block_s;
+
+#define HAS_NEIGHBOR(BLOCK, DIR) ((BLOCK)->neighbors[DIR] != MPI_PROC_NULL)
+
+typedef struct pool pool_s;
+
+// Stored area of a worker split into tiles. Owned area is split
+// into TILE_LINES x TILE_UNITS tiles, halo on each side forms
+// its own row(column) of thin tiles. Tile (i, j) covers lines
+// [line_bounds[i], line_bounds[i+1]) and units
+// [unit_bounds[j], unit_bounds[j+1]) of the stored area.
+typedef struct {
+	int rows, cols;
+	int* line_bounds;
+	int* unit_bounds;
+	// Whether any calculated cell of the tile has changed at the
+	// previous generation, and at the one being calculated
+	unsigned char* changed;
+	unsigned char* next_changed;
+	// Threads calculating tiles
+	pool_s* pool;
+	// Time spent calculating since last rebalancing
+	double busy_time;
+} tiles_s;
+
+// Threads of a worker. Thread 0 is the one making MPI calls, it
+// hands out tiles of each rectangle being calculated to the others
+// and waits for them at a barrier.
+struct pool {
+	int threads_num;
+	pthread_t* threads;
+	struct pool_thread* thread_args;
+	pthread_barrier_t start, finish;
+	// Rectangle being calculated
+	const block_s* block;
+	tiles_s* tiles;
+	cell_t* arena_input;
+	cell_t* arena_output;
+	range_s lines, units;
+	// Set when threads have to exit
+	int stop;
+};
+
+struct pool_thread {
+	pool_s* pool;
+	int index;
+};
+
 void graceful_abort(int signum)
 {
 	fprintf(stderr, "ERROR");
 	MPI_Abort(MPI_COMM_WORLD, 1);
 }
 
-void dump_arena_state(char* arena, int n)
+// Splits [0, total) into parts, first total % parts
+// of them get one extra element
+range_s split_range(int total, int parts, int i)
+{
+	int quota = total / parts;
+	int extra = total % parts;
+	range_s range;
+	range.begin = i * quota + ((i < extra) ? i : extra);
+	range.end   = range.begin + quota + (i < extra);
+	return range;
+}
+
+// Lines owned by worker number i(i = rank - 1)
+range_s zone_lines(int i)
+{
+	range_s lines = {LINE_BOUNDS[i / GRID[1]], LINE_BOUNDS[i / GRID[1] + 1]};
+	return lines;
+}
+
+// Units of each line owned by worker number i
+range_s zone_units(int i)
+{
+	return split_range(ROW_UNITS, GRID[1], i % GRID[1]);
+}
+
+// Moves boundaries between rows of the grid so that each of them gets
+// an equal share of calculation time of the previous period. Time of a
+// row is the time of its slowest worker spread evenly over its lines.
+// Boundary moves no further than the farthest line of adjacent rows,
+// so lines migrate between neighbors only, and each row keeps enough
+// lines to fill halo. Returns whether any boundary has moved.
+int balance_lines(const double* times)
+{
+	int rows = GRID[0];
+	double* costs = (double*)calloc(rows, sizeof(double));
+	assert(costs);
+	double total = 0.0, max = 0.0;
+	for (int r = 0; r < rows; r++) {
+		for (int c = 0; c < GRID[1]; c++)
+			if (times[r * GRID[1] + c] > costs[r])
+				costs[r] = times[r * GRID[1] + c];
+		total += costs[r];
+		if (costs[r] > max)
+			max = costs[r];
+	}
+	if ((total <= 0.0) || (max * rows < BALANCE_THRESHOLD * total)) {
+		free(costs);
+		return 0;
+	}
+	// Lines of idle rows are not free, otherwise
+	// all of them would be given to a single row
+	for (int r = 0; r < rows; r++)
+		costs[r] += 1e-3 * total / rows;
+	total *= 1.0 + 1e-3;
+
+	// Costs are spread over lines of the previous layout
+	int* old = (int*)calloc(rows + 1, sizeof(int));
+	assert(old);
+	memcpy(old, LINE_BOUNDS, (rows + 1) * sizeof(int));
+	int moved = 0;
+	double cost = 0.0;
+	int row = 0;
+	for (int r = 1; r < rows; r++) {
+		// Line where cumulative cost reaches r shares of it
+		double share = total * r / rows;
+		while (cost + costs[row] < share) {
+			cost += costs[row];
+			row++;
+		}
+		int target = old[row] + (int)((share - cost) / costs[row] *
+		                              (old[row + 1] - old[row]) + 0.5);
+		// Times are noisy and activity moves, boundary goes
+		// half of the way so that it does not oscillate
+		target = old[r] + (target - old[r]) / 2;
+
+		int low = LINE_BOUNDS[r - 1] + HALO_DEPTH;
+		if (low < old[r - 1])
+			low = old[r - 1];
+		int high = old[r + 1] - HALO_DEPTH;
+		if (target < low)
+			target = low;
+		if (target > high)
+			target = high;
+		LINE_BOUNDS[r] = target;
+		moved |= (target != old[r]);
+	}
+	free(old);
+	free(costs);
+	return moved;
+}
+
+// splitmix64, so soups do not depend on C library
+uint64_t next_random(uint64_t* state)
+{
+	uint64_t z = (*state += 0x9e3779b97f4a7c15ull);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	return z ^ (z >> 31);
+}
+
+// Population and checksum of alive cells owned by the worker. Checksum
+// is a sum of hashes of cell indices, so it does not depend on the
+// order in which cells and workers are added up.
+void count_cells(const block_s* block, const cell_t* arena, uint64_t* counts)
+{
+	int owned_offset = block->first_line * block->units_num + block->first_unit;
+	int owned_units = block->units.end - block->units.begin;
+	counts[0] = counts[1] = 0;
+	for (int i = block->lines.begin; i < block->lines.end; i++) {
+		const cell_t* line = &arena[owned_offset + (i - block->lines.begin) * block->units_num];
+		for (int u = 0; u < owned_units; u++) {
+#ifdef CHAR_ARENA
+			uint64_t bits = line[u] ? 1 : 0;
+#else
+			uint64_t bits = line[u];
+#endif
+			while (bits) {
+				int j = (block->units.begin + u) * CELLS_PER_UNIT + __builtin_ctzll(bits);
+				bits &= bits - 1;
+				uint64_t state = (uint64_t)i * WIDTH + j;
+				counts[0]++;
+				counts[1] += next_random(&state);
+			}
+		}
+	}
+}
+
+// Terminal is only drawn in if the arena is that narrow
+#define TERMINAL_WIDTH 60
+
+// Root keeps the whole arena and workers send it
+// frames only if it is shown somewhere
+int root_draws(void)
+{
+	if (BENCHMARK)
+		return 0;
+#ifdef DRAW_WITH_SDL
+	return 1;
+#else
+	return WIDTH <= TERMINAL_WIDTH;
+#endif
+}
+
+void dump_arena_state(char* arena)
 {
 	// Too big to draw in terminal
-	if (N > 60)
+	if ((WIDTH > TERMINAL_WIDTH) || BENCHMARK)
 		return;
 
 	printf("\033[H\033[J");
 	printf("+");
-	for (int i = 0; i < n; i++)
+	for (int i = 0; i < WIDTH; i++)
 		printf("-");
 	printf("+\n|");
-	for (int i = 0; i < n; i++) {
-		for (int j = 0; j < n; j++)
-			putchar(arena[i * n + j] ? 'x' : ' ');
-		printf("|\n%s", (i == n - 1) ? "" : "|");
+	for (int i = 0; i < HEIGHT; i++) {
+		for (int j = 0; j < WIDTH; j++)
+			putchar(arena[i * WIDTH + j] ? 'x' : ' ');
+		printf("|\n%s", (i == HEIGHT - 1) ? "" : "|");
 	}
 	printf("+");
-	for (int i = 0; i < n; i++)
+	for (int i = 0; i < WIDTH; i++)
 		printf("-");
 	printf("+\n");
 #ifdef DELAY_WHEN_DRAWING_IN_TERMINAL
@@ -115,389 +413,2047 @@ void dump_arena_state(char* arena, int n)
 #endif
 }
 
-#define input_nonoptimized(I, J) \
-	( ((I >= 0) && (I < lines_num) && (J >= 0) && (J < N) ) \
-	  ?          arena_input[(I) * N + (J)]                 \
-	  :                     0                             )
+#ifdef CHAR_ARENA
 
+// Neighbors of calculated cells are always stored
 #define input(I, J) \
-	((I >= 0) && (I < lines_num) && (J >= 0) && (J < N) && arena_input[(I) * N + (J)])
+	(arena_input[(I) * units_num + (J)] != 0)
 
 #define output(I, J) \
-	arena_output[I * N + J]
+	arena_output[I * units_num + J]
 
-void calculate_region(unsigned char* arena_input, unsigned char* arena_output, int size, int rank)
+// Calculates next state of cells of the stored area which lie
+// inside of lines x units rectangle. Returns nonzero if any of them
+// has changed.
+int calculate_rect(const block_s* block, cell_t* arena_input, cell_t* arena_output,
+                   range_s lines, range_s units)
 {
-	int is_first = (rank == 1);
-	int is_last  = (rank == MPI_SIZE - 1);
+	int units_num = block->units_num;
+	int changed = 0;
 
-	int lines_num = size / N;
-	int first_line = 1 - is_first;
-	int last_line = lines_num - (1 - is_last);
-
-	for (int i = 0; i < lines_num; i++) {
-		for (int j = 0; j < N; j++) {
+	for (int i = lines.begin; i < lines.end; i++) {
+		for (int j = units.begin; j < units.end; j++) {
 			int neighbors_num =
 				input(i-1, j-1) + input(i-1, j) + input(i-1, j+1) +
 				input(i  , j-1) +      0        + input(i  , j+1) +
 				input(i+1, j-1) + input(i+1, j) + input(i+1, j+1);
 #ifdef COLORED_CELLS
-			output(i, j) = (arena_input[i * N + j] + 12 * (arena_input[i * N + j] != 253)) *
+			output(i, j) = (arena_input[i * units_num + j] + 12 * (arena_input[i * units_num + j] != 253)) *
 #else
 			output(i, j) =
 #endif
-				((neighbors_num == 3) || input(i, j) && (neighbors_num == 2));
+				(((input(i, j) ? RULE.survival : RULE.birth) >> neighbors_num) & 1);
+			changed |= (output(i, j) != arena_input[i * units_num + j]);
 		}
 	}
-
-	if (!is_first) {
-		MPI_Recv(&arena_output[0], N, MPI_CHAR,
-				rank - 1, 0, MPI_COMM_WORLD, NULL);
-		MPI_Send(&arena_output[N], N, MPI_CHAR,
-				rank - 1, 0, MPI_COMM_WORLD);
-	}
-	if (!is_last) {
-		MPI_Send(&arena_output[size - 2 * N], N, MPI_CHAR,
-				rank + 1, 0, MPI_COMM_WORLD);
-		MPI_Recv(&arena_output[size - N], N, MPI_CHAR,
-				rank + 1, 0, MPI_COMM_WORLD, NULL);
-	}
+	return changed;
 }
 
-#undef input_nonoptimized
 #undef input
 #undef output
 
-void worker_func(int rank)
+#else // !CHAR_ARENA
+
+// Adds three one-bit numbers in every bit position at once
+#define FULL_ADDER(A, B, C, SUM, CARRY) do { \
+	uint64_t ab_ = (A) ^ (B);            \
+	SUM   = ab_ ^ (C);                   \
+	CARRY = ((A) & (B)) | (ab_ & (C));   \
+} while (0)
+
+// Line shifted so that bit j holds cell j-1 (j+1)
+// of the same line, i.e. its western (eastern) neighbor
+#define WEST(LINE, U) \
+	(((LINE)[U] << 1) | ((LINE)[(U) - 1] >> 63))
+#define EAST(LINE, U) \
+	(((LINE)[U] >> 1) | ((LINE)[(U) + 1] << 63))
+
+// Each of 64 cells of the word is processed simultaneously:
+// eight neighbor bitboards are summed by the adder tree into bits
+// of the neighbors number (count0 + 2*count1 + 4*count2 + 8*count3).
+// Kernel for each rule is generated from the expression NEXT giving
+// next state of the word from these bits and current state(cell).
+// Neighbors of calculated cells are always stored, so the inner
+// loop has no branches and is vectorized by the compiler.
+#define DEFINE_CALCULATE_RECT(NAME, NEXT)                                                \
+int NAME(const block_s* block, cell_t* arena_input, cell_t* arena_output,                \
+         range_s lines, range_s units)                                                   \
+{                                                                                        \
+	int units_num = block->units_num;                                                \
+	const uint64_t* restrict masks = block->unit_masks;                              \
+	uint64_t changed = 0;                                                            \
+                                                                                         \
+	for (int i = lines.begin; i < lines.end; i++) {                                  \
+		const uint64_t* restrict up   = &arena_input[(i - 1) * units_num];       \
+		const uint64_t* restrict mid  = &arena_input[ i      * units_num];       \
+		const uint64_t* restrict down = &arena_input[(i + 1) * units_num];       \
+		uint64_t* restrict out = &arena_output[i * units_num];                   \
+                                                                                         \
+		for (int u = units.begin; u < units.end; u++) {                          \
+			uint64_t s_up, c_up, s_down, c_down, s_mid, c_mid;               \
+			FULL_ADDER(WEST(up, u),   up[u],   EAST(up, u),   s_up,   c_up);   \
+			FULL_ADDER(WEST(down, u), down[u], EAST(down, u), s_down, c_down); \
+			uint64_t west = WEST(mid, u), east = EAST(mid, u);               \
+			s_mid = west ^ east;                                             \
+			c_mid = west & east;                                             \
+                                                                                         \
+			uint64_t count0, carry0;                                         \
+			FULL_ADDER(s_up, s_down, s_mid, count0, carry0);                 \
+			uint64_t twos, fours;                                            \
+			FULL_ADDER(c_up, c_down, c_mid, twos, fours);                    \
+			uint64_t count1 = twos ^ carry0;                                 \
+			uint64_t count2 = fours ^ (twos & carry0);                       \
+			uint64_t count3 = fours & twos & carry0;                         \
+			uint64_t cell = mid[u];                                          \
+			(void)count3;                                                    \
+                                                                                         \
+			out[u] = (NEXT) & masks[u];                                      \
+			changed |= out[u] ^ cell;                                        \
+		}                                                                        \
+	}                                                                                \
+	return (changed != 0);                                                           \
+}
+
+// Count is 8 only if count3 is set, with count0..count2 being zero then,
+// so specialized kernels without 8 in the rule do not look at count3.
+
+// B3/S23: 3 neighbors, or 2 neighbors and cell is alive
+DEFINE_CALCULATE_RECT(calculate_rect_life,
+	count1 & ~count2 & (count0 | cell))
+// B36/S23: also born with 6(110) neighbors
+DEFINE_CALCULATE_RECT(calculate_rect_highlife,
+	count1 & ((~count2 & (count0 | cell)) | (count2 & ~count0 & ~cell)))
+// B3678/S34678: 3, 6, 7 or 8 neighbors, or 4 neighbors and cell is alive
+DEFINE_CALCULATE_RECT(calculate_rect_day_and_night,
+	count3 | (count1 & (count2 | count0)) | (cell & count2 & ~count1 & ~count0))
+// B2/S: dead cell with 2 neighbors
+DEFINE_CALCULATE_RECT(calculate_rect_seeds,
+	~cell & ~count0 & count1 & ~count2)
+
+// Any rule, cells with each number of neighbors
+// present in the rule are selected one by one
+static inline uint64_t next_state(uint64_t count0, uint64_t count1, uint64_t count2,
+                                  uint64_t count3, uint64_t cell)
 {
-	int zone_size = (N * N) / (MPI_SIZE - 1);
-	int size = zone_size + 2 * N;
-	if (rank == 1)
-		size -= N;
-	if (rank == MPI_SIZE - 1)
-		size -= N;
+	uint64_t res = 0;
+	for (int n = 0; n <= 8; n++) {
+		int born = (RULE.birth >> n) & 1;
+		int survives = (RULE.survival >> n) & 1;
+		if (!born && !survives)
+			continue;
+		uint64_t eq = ((n & 1) ? count0 : ~count0) & ((n & 2) ? count1 : ~count1) &
+		              ((n & 4) ? count2 : ~count2) & ((n & 8) ? count3 : ~count3);
+		res |= eq & ((born ? ~cell : 0) | (survives ? cell : 0));
+	}
+	return res;
+}
 
-	// One is for current iteration, another is for the next
-	char* arena1 = (char*)calloc(size, sizeof(char));
-	assert(arena1);
-	char* arena2 = (char*)calloc(size, sizeof(char));
-	assert(arena2);
+DEFINE_CALCULATE_RECT(calculate_rect_generic,
+	next_state(count0, count1, count2, count3, cell))
 
-	char* arena_input  = arena1;
-	char* arena_output = arena2;
-	char* tmp = NULL;
+typedef int (*calculate_rect_f)(const block_s* block, cell_t* arena_input,
+                                cell_t* arena_output, range_s lines, range_s units);
 
-	MPI_Recv(arena_input, size, MPI_CHAR, 0, 0, MPI_COMM_WORLD, NULL);
+#define RULE_MASK(N0, N1, N2, N3, N4, N5, N6, N7, N8) \
+	((N0) | (N1) << 1 | (N2) << 2 | (N3) << 3 | (N4) << 4 | \
+	 (N5) << 5 | (N6) << 6 | (N7) << 7 | (N8) << 8)
 
-	int command = COMMAND_INVALID;
-	while (1) {
-		MPI_Bcast(&command, 1, MPI_INT, 0, MPI_COMM_WORLD);
-		if (command == COMMAND_HALT) {
-			break;
-		}
-		assert(command < COMMAND_INVALID && command >= 0);
-		// Calculate
-		calculate_region(arena_input, arena_output, size, rank);
-		// Send result back
-		if (command == COMMAND_CONTINUE)
-			MPI_Send(arena_output, size, MPI_CHAR, 0, 0, MPI_COMM_WORLD);
-		else {
-			assert(command == COMMAND_CONTINUE_FAST_FORWARD);
-			int status = 1;
-			MPI_Send(&status, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+static const struct {
+	rule_s rule;
+	calculate_rect_f kernel;
+} RULE_KERNELS[] = {
+	{{RULE_MASK(0,0,0,1,0,0,0,0,0), RULE_MASK(0,0,1,1,0,0,0,0,0)}, &calculate_rect_life},
+	{{RULE_MASK(0,0,0,1,0,0,1,0,0), RULE_MASK(0,0,1,1,0,0,0,0,0)}, &calculate_rect_highlife},
+	{{RULE_MASK(0,0,0,1,0,0,1,1,1), RULE_MASK(0,0,0,1,1,0,1,1,1)}, &calculate_rect_day_and_night},
+	{{RULE_MASK(0,0,1,0,0,0,0,0,0), RULE_MASK(0,0,0,0,0,0,0,0,0)}, &calculate_rect_seeds},
+};
+
+#undef RULE_MASK
+
+// Kernel of RULE, chosen once
+calculate_rect_f RULE_KERNEL = &calculate_rect_generic;
+
+void select_rule_kernel(void)
+{
+	RULE_KERNEL = &calculate_rect_generic;
+	for (int i = 0; i < sizeof(RULE_KERNELS)/sizeof(RULE_KERNELS[0]); i++)
+		if ((RULE_KERNELS[i].rule.birth == RULE.birth) &&
+		    (RULE_KERNELS[i].rule.survival == RULE.survival))
+			RULE_KERNEL = RULE_KERNELS[i].kernel;
+}
+
+// Calculates next state of cells of the stored area which lie
+// inside of lines x units rectangle. Returns nonzero if any of them
+// has changed.
+int calculate_rect(const block_s* block, cell_t* arena_input, cell_t* arena_output,
+                   range_s lines, range_s units)
+{
+	return RULE_KERNEL(block, arena_input, arena_output, lines, units);
+}
+
+#undef DEFINE_CALCULATE_RECT
+#undef FULL_ADDER
+#undef WEST
+#undef EAST
+
+#endif // CHAR_ARENA
+
+// Offset of the halo sent to (received from) neighbor in direction dir
+int halo_offset(const block_s* block, int dir, int is_recv)
+{
+	int line = block->first_line;
+	int unit = block->first_unit;
+	int owned_lines = block->lines.end - block->lines.begin;
+	int owned_units = block->units.end - block->units.begin;
+
+	if (DIR_OFFSET[dir][0] < 0)
+		line = is_recv ? line - block->halo_lines : line;
+	else if (DIR_OFFSET[dir][0] > 0)
+		line = is_recv ? line + owned_lines : line + owned_lines - block->halo_lines;
+	if (DIR_OFFSET[dir][1] < 0)
+		unit = is_recv ? unit - block->halo_units : unit;
+	else if (DIR_OFFSET[dir][1] > 0)
+		unit = is_recv ? unit + owned_units : unit + owned_units - block->halo_units;
+
+	return line * block->units_num + unit;
+}
+
+// Number of lines and units of the halo sent to(received from) neighbor in direction dir
+void halo_shape(const block_s* block, int dir, int* lines, int* units)
+{
+	*lines = DIR_OFFSET[dir][0] ? block->halo_lines : block->lines.end - block->lines.begin;
+	*units = DIR_OFFSET[dir][1] ? block->halo_units : block->units.end - block->units.begin;
+}
+
+int is_halo_empty(const block_s* block, const cell_t* arena, int dir, int is_recv)
+{
+	int lines, units;
+	halo_shape(block, dir, &lines, &units);
+	const cell_t* halo = &arena[halo_offset(block, dir, is_recv)];
+	for (int i = 0; i < lines; i++)
+		for (int j = 0; j < units; j++)
+			if (halo[i * block->units_num + j])
+				return 0;
+	return 1;
+}
+
+void clear_halo(const block_s* block, cell_t* arena, int dir)
+{
+	int lines, units;
+	halo_shape(block, dir, &lines, &units);
+	cell_t* halo = &arena[halo_offset(block, dir, 1)];
+	for (int i = 0; i < lines; i++)
+		memset(&halo[i * block->units_num], 0, units * sizeof(cell_t));
+}
+
+void block_init(block_s* block, MPI_Comm workers_comm, int rank)
+{
+	int periods[2] = {TORUS, TORUS};
+	// Cartesian ranks have to match ranks used by root
+	MPI_Cart_create(workers_comm, 2, GRID, periods, 0, &block->comm);
+
+	int coords[2];
+	MPI_Cart_coords(block->comm, rank - 1, 2, coords);
+	for (int dir = 0; dir < DIRECTIONS_NUM; dir++) {
+		int nb_coords[2] = {
+			coords[0] + DIR_OFFSET[dir][0],
+			coords[1] + DIR_OFFSET[dir][1],
+		};
+		if (TORUS) {
+			nb_coords[0] = (nb_coords[0] + GRID[0]) % GRID[0];
+			nb_coords[1] = (nb_coords[1] + GRID[1]) % GRID[1];
 		}
-		// Exchange values of arena_input, arena_output pointers
-		tmp = arena_input; arena_input = arena_output; arena_output = tmp;
+		if ((nb_coords[0] < 0) || (nb_coords[0] >= GRID[0]) ||
+		    (nb_coords[1] < 0) || (nb_coords[1] >= GRID[1]))
+			block->neighbors[dir] = MPI_PROC_NULL;
+		else
+			MPI_Cart_rank(block->comm, nb_coords, &block->neighbors[dir]);
 	}
 
-	free(arena1);
-	free(arena2);
+	block->lines = zone_lines(rank - 1);
+	block->units = zone_units(rank - 1);
+	int owned_lines = block->lines.end - block->lines.begin;
+	int owned_units = block->units.end - block->units.begin;
+
+	block->halo_lines = HALO_DEPTH;
+	block->halo_units = (HALO_DEPTH + CELLS_PER_UNIT - 1) / CELLS_PER_UNIT;
+	block->first_line = block->halo_lines;
+	block->first_unit = block->halo_units + PAD_UNITS;
+	block->lines_num  = owned_lines + 2 * block->first_line;
+	block->units_num  = owned_units + 2 * block->first_unit;
+
+#ifndef CHAR_ARENA
+	// Cells beyond the border may be calculated as alive, even in
+	// a copy of the last unit kept in halo. Torus is as wide as a
+	// whole number of units, so there are no such cells then.
+	block->unit_masks = (cell_t*)calloc(block->units_num, sizeof(cell_t));
+	assert(block->unit_masks);
+	for (int u = 0; u < block->units_num; u++)
+		block->unit_masks[u] = ~(uint64_t)0;
+	int last_unit = ROW_UNITS - 1 - (block->units.begin - block->first_unit);
+	if (last_unit < block->units_num)
+		block->unit_masks[last_unit] = LAST_UNIT_MASK;
+#endif
+
+	for (int dir = 0; dir < DIRECTIONS_NUM; dir++) {
+		int lines, units;
+		halo_shape(block, dir, &lines, &units);
+		MPI_Type_vector(lines, units, block->units_num, MPI_CELL_T,
+		                &block->halo_types[dir]);
+		MPI_Type_commit(&block->halo_types[dir]);
+	}
+	MPI_Type_vector(owned_lines, owned_units, block->units_num, MPI_CELL_T,
+	                &block->owned_type);
+	MPI_Type_commit(&block->owned_type);
 }
 
-void initialize_arena(char* arena)
+void block_destroy(block_s* block)
 {
-#ifdef ARENA_FIGURES
-	// Glider
-	struct {
-		int y, x;
-	} points[] = {
-		// Glider
-		{1, 2},
-		{2, 3},
-		{3, 1},
-		{3, 2},
-		{3, 3},
-		// Blinker
-		{2, 9},
-		{2, 10},
-		{2, 11},
-	};
-	for (int i = 0; i < sizeof(points)/sizeof(points[0]); i++) {
-		arena[N * points[i].y + points[i].x] = 1;
+#ifndef CHAR_ARENA
+	free(block->unit_masks);
+#endif
+	for (int dir = 0; dir < DIRECTIONS_NUM; dir++)
+		MPI_Type_free(&block->halo_types[dir]);
+	MPI_Type_free(&block->owned_type);
+	MPI_Comm_free(&block->comm);
+}
+
+// Starts filling halo with owned cells of neighbors. Corners are
+// exchanged directly with diagonal neighbors, so all messages are
+// independent and may be in flight simultaneously.
+void exchange_halo_start(const block_s* block, cell_t* arena,
+                         MPI_Request requests[2 * DIRECTIONS_NUM])
+{
+	for (int dir = 0; dir < DIRECTIONS_NUM; dir++) {
+		int opposite = dir ^ 1;
+		// Message sent in direction dir is tagged with dir
+		MPI_Irecv(&arena[halo_offset(block, opposite, 1)], 1,
+		          block->halo_types[opposite], block->neighbors[opposite], dir,
+		          block->comm, &requests[2 * dir]);
+		// Halo of dead cells is sent as a message without data
+		int empty = HAS_NEIGHBOR(block, dir) && is_halo_empty(block, arena, dir, 0);
+		MPI_Isend(&arena[halo_offset(block, dir, 0)], !empty,
+		          block->halo_types[dir], block->neighbors[dir], dir,
+		          block->comm, &requests[2 * dir + 1]);
 	}
-	dump_arena_state(arena, N);
-#else
-	// Decode rle
-	FILE* file = fopen(RLE_FILE_NAME, "rb");
-	assert(file);
-	int arena_i = 0, arena_j = 0;
-	int r1, r2;
-	int cnt = 0;
-	int c = 0;
-	while (1) {
-		r1 = fscanf(file, "%d", &cnt);
-		if (r1 <= 0)
-			cnt = 1;
-		r2 = fscanf(file, "%c", &c);
-		if (r2 <= 0)
-			break;
-		if (c == 'o') {
-			for (int i = 0; i < cnt; i++) {
-				arena[arena_i * N + arena_j] = 1;
-				arena_j++;
-			}
-		} else if (c == 'b') {
-			arena_j += cnt;
-		} else if (c == '$') {
-			arena_j = 0;
-			arena_i += cnt;
-		} else {
-			assert(0);
-		}
+}
+
+void exchange_halo_finish(const block_s* block, cell_t* arena,
+                          MPI_Request requests[2 * DIRECTIONS_NUM])
+{
+	MPI_Status statuses[2 * DIRECTIONS_NUM];
+	prof_switch(PROF_HALO_WAIT);
+	MPI_Waitall(2 * DIRECTIONS_NUM, requests, statuses);
+	prof_switch(PROF_HALO);
+	for (int dir = 0; dir < DIRECTIONS_NUM; dir++) {
+		int opposite = dir ^ 1;
+		if (!HAS_NEIGHBOR(block, opposite))
+			continue;
+		int count;
+		MPI_Get_count(&statuses[2 * dir], block->halo_types[opposite], &count);
+		if (count == 0)
+			clear_halo(block, arena, opposite);
 	}
-	dump_arena_state(arena, N);
-	//MPI_Abort(MPI_COMM_WORLD, 1);
-	fclose(file);
-#endif
 }
 
-void root_func(void* renderer_arg)
+void exchange_halo(const block_s* block, cell_t* arena)
 {
-	char* arena = (char*)calloc(N * N, sizeof(char));
-	assert(arena);
+	MPI_Request requests[2 * DIRECTIONS_NUM];
+	exchange_halo_start(block, arena, requests);
+	exchange_halo_finish(block, arena, requests);
+}
 
-	initialize_arena(arena);
+// Splits [0, total) into tiles: [0, first) and [first + owned, total)
+// are tiles of their own, owned part is split into tiles of given size.
+// Returns number of tiles, bounds[num] is set to total.
+int tile_bounds(int first, int owned, int total, int tile, int* bounds)
+{
+	int num = 0;
+	if (first > 0)
+		bounds[num++] = 0;
+	for (int i = first; i < first + owned; i += tile)
+		bounds[num++] = i;
+	if (first + owned < total)
+		bounds[num++] = first + owned;
+	bounds[num] = total;
+	return num;
+}
 
-	int workers_num = MPI_SIZE - 1;
-	int arena_size = N * N;
-	int zone_size = arena_size / workers_num;
-	/* ARENA scheme
-	 *
-	 * Numbers in brackets correspond to ranks of
-	 * processes responsible for areas.
-	 *
-	 * Cells marked as = are shared between processes
-	 * and being exchanged.
-	 *
-	 * Root process only sends initial areas' values, then
-	 * it just broadcasts 'continue' or 'halt' messages in
-	 * order to continue or stop simulation and collects
-	 * arena states' data.
-	 *
-	 * MPI_SIZE = 4, workers_num = 3, N = 12
-	 * zone_size   = (12*12)/3 = 48
-	 * zone_size/N = 48/12 = 4
-	 *
-	 *            N
-	 *     |<---------->|
-	 *     |            |
-	 *
-	 *     +------------+ ---
-	 *    0|            |   ^
-	 *    1|     (1)    |   | (zone_size / N) = 4
-	 *    2|            |   |
-	 *    3|============|   V
-	 *    4|============| ---
-	 *    5|     (2)    |
-	 *    6|            |
-	 *    7|============|
-	 *    8|============|
-	 *    9|            |
-	 *   10|     (3)    |
-	 *   11|            |
-	 *     +------------+
-	 */
+void tiles_init(tiles_s* tiles, const block_s* block, pool_s* pool)
+{
+	int owned_lines = block->lines.end - block->lines.begin;
+	int owned_units = block->units.end - block->units.begin;
 
-	// Send initial arena state to workers.
-	//
-	// Below is the number of cells that each type of worker
-	// stores/exclusively owns. Also stored range is listed(i = rank - 1).
-	//  worker  |     stores        |    excl owns       |        range stored
-	// ---------+-------------------+--------------------+---------------------------------
-	//  first   |  zone_size + N    |   zone_size - N    | i*zone_size  :(i+1)*zone_size+N
-	//  middle  |  zone_size + 2*N  |   zone_size - 2*N  | i*zone_size-N:(i+1)*zone_size+N
-	//  last    |  zone_size + N    |   zone_size        | i*zone_size-N:(i+1)*zone_size
-	//
-	// In case of a single process it owns all cells it receives,
-	// i.e. zone_size = arena_size cells.
-	for (int i = 0; i < workers_num; i++) {
-		// Works even for corner case of single process
-		int begin = i     * zone_size - N;
-		int end   = (i+1) * zone_size + N;
-		if (i == 0)
-			begin += N;
-		if (i == workers_num - 1)
-			end   -= N;
-
-		// TODO: change to MPI_Scatter
-		MPI_Send(&arena[begin], end - begin, MPI_CHAR,
-				i + 1, 0, MPI_COMM_WORLD);
-	}
+	tiles->line_bounds = (int*)calloc(owned_lines / TILE_LINES + 4, sizeof(int));
+	assert(tiles->line_bounds);
+	tiles->unit_bounds = (int*)calloc(owned_units / TILE_UNITS + 4, sizeof(int));
+	assert(tiles->unit_bounds);
+	tiles->rows = tile_bounds(block->first_line, owned_lines, block->lines_num,
+	                          TILE_LINES, tiles->line_bounds);
+	tiles->cols = tile_bounds(block->first_unit, owned_units, block->units_num,
+	                          TILE_UNITS, tiles->unit_bounds);
 
-	int command = COMMAND_CONTINUE;
+	tiles->changed = (unsigned char*)calloc(tiles->rows * tiles->cols, 1);
+	assert(tiles->changed);
+	tiles->next_changed = (unsigned char*)calloc(tiles->rows * tiles->cols, 1);
+	assert(tiles->next_changed);
+	// Nothing is known about initial state
+	memset(tiles->changed, 1, tiles->rows * tiles->cols);
+	tiles->pool = pool;
+	tiles->busy_time = 0.0;
+}
 
-	int fps = 0, prev_iter_num = 0;
-	double prev_time = MPI_Wtime();
+void tiles_destroy(tiles_s* tiles)
+{
+	free(tiles->line_bounds);
+	free(tiles->unit_bounds);
+	free(tiles->changed);
+	free(tiles->next_changed);
+}
 
-#ifdef DRAW_WITH_SDL
-	int iter_num = 0;
-	SDL_Event event;
-	while (1) {
-		iter_num++;
-		while (SDL_PollEvent(&event))
-			iter_num++;
-			if(event.type == SDL_QUIT)
-				goto out;
-#else
-	fprintf(stderr, "\n");
-	for (int iter_num = 0; iter_num < ITER_NUM; iter_num++) {
-#endif
-		// Fast-forward calculation
-		if (iter_num % ITERATIONS_PER_FRAME == 0)
-			command = COMMAND_CONTINUE;
-		else
-			command = COMMAND_CONTINUE_FAST_FORWARD;
-		// Update fps
-		if (iter_num % ITERATIONS_PER_FPS_UPDATE == 1) {
-			double cur_time = MPI_Wtime();
-			fps = (iter_num - prev_iter_num) / (cur_time - prev_time);
-			prev_time = cur_time;
-			prev_iter_num = iter_num;
+int is_halo_tile(const block_s* block, const tiles_s* tiles, int i, int j)
+{
+	int line = tiles->line_bounds[i];
+	int unit = tiles->unit_bounds[j];
+	return (line < block->first_line) ||
+	       (line >= block->first_line + block->lines.end - block->lines.begin) ||
+	       (unit < block->first_unit) ||
+	       (unit >= block->first_unit + block->units.end - block->units.begin);
+}
+
+// Owned tile keeps its state if neither it nor any of its neighbors
+// has changed at the previous generation. Both arenas hold the same
+// state of such tile then, so it is just skipped. Halo tiles are thin
+// and are always calculated.
+int is_tile_active(const block_s* block, const tiles_s* tiles, int i, int j)
+{
+	if (is_halo_tile(block, tiles, i, j))
+		return 1;
+	for (int ni = i - 1; ni <= i + 1; ni++) {
+		for (int nj = j - 1; nj <= j + 1; nj++) {
+			if ((ni < 0) || (ni >= tiles->rows) || (nj < 0) || (nj >= tiles->cols))
+				continue;
+			if (tiles->changed[ni * tiles->cols + nj])
+				return 1;
 		}
-		// Print iteration number and fps
-		fprintf(stderr, "\riteration %3d, fps %3d", iter_num, fps);
-		// Send command to processes
-		MPI_Bcast(&command, 1, MPI_INT, 0, MPI_COMM_WORLD);
-		// Get results
-		if (command == COMMAND_CONTINUE_FAST_FORWARD) {
-			// Collect statuses
-			int status;
-			for (int i = 0; i < workers_num; i++) {
-				MPI_Recv(&status, 1, MPI_INT,
-					i + 1, 0, MPI_COMM_WORLD, NULL);
-				assert(status == 1);
-			}
-		} else if (command == COMMAND_CONTINUE) {
-			// Collect data
-			for (int i = 0; i < workers_num; i++) {
-				int begin = i     * zone_size - N;
-				int end   = (i+1) * zone_size + N;
-				if (i == 0)
-					begin += N;
-				if (i == workers_num - 1)
-					end   -= N;
-				// TODO: change to MPI_Gather
-				MPI_Recv(&arena[begin], end - begin, MPI_CHAR,
-						i + 1, 0, MPI_COMM_WORLD, NULL);
-			}
-			// Show data
-			dump_arena_state(arena, N);
-#ifdef DRAW_WITH_SDL
-			SDL_Renderer* renderer = renderer_arg;
+	}
+	return 0;
+}
 
-			// Clear screen
-			SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-			SDL_RenderClear(renderer);
-			// Draw
-#ifndef COLORED_CELLS
-			SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-#endif
-			for (int i = 0; i < arena_size; i++) {
-				if (arena[i]) {
-#ifdef COLORED_CELLS
-					SDL_SetRenderDrawColor(renderer,
-							0,
-							255 - (unsigned char)arena[i],
-							(unsigned char)arena[i],
-							255);
-#endif
-					SDL_RenderDrawPoint(renderer, i % N, i / N);
-				}
+// Halo has just been received into arena_input, while arena_output
+// keeps halo used at the previous generation. Halo tile is marked as
+// changed if cells adjacent to owned area differ in them(whole units
+// of the packed arena are compared).
+void update_halo_tiles(const block_s* block, tiles_s* tiles,
+                       const cell_t* arena_input, const cell_t* arena_output)
+{
+	int owned_lines = block->lines.end - block->lines.begin;
+	int owned_units = block->units.end - block->units.begin;
+
+	for (int i = 0; i < tiles->rows; i++) {
+		for (int j = 0; j < tiles->cols; j++) {
+			if (!is_halo_tile(block, tiles, i, j))
+				continue;
+			int line_begin = tiles->line_bounds[i];
+			int line_end   = tiles->line_bounds[i + 1];
+			int unit_begin = tiles->unit_bounds[j];
+			int unit_end   = tiles->unit_bounds[j + 1];
+			if (line_begin < block->first_line - 1)
+				line_begin = block->first_line - 1;
+			if (line_end > block->first_line + owned_lines + 1)
+				line_end = block->first_line + owned_lines + 1;
+			if (unit_begin < block->first_unit - 1)
+				unit_begin = block->first_unit - 1;
+			if (unit_end > block->first_unit + owned_units + 1)
+				unit_end = block->first_unit + owned_units + 1;
+
+			int changed = 0;
+			for (int l = line_begin; l < line_end; l++) {
+				size_t offset = (size_t)l * block->units_num + unit_begin;
+				changed |= memcmp(&arena_input[offset], &arena_output[offset],
+				                  (unit_end - unit_begin) * sizeof(cell_t)) != 0;
 			}
-#  ifdef SHOW_WORKERS_BORDERS
-			SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-			for (int i = 0; i < workers_num; i++)
-				for (int j = 0; j < N; j++)
-					SDL_RenderDrawPoint(renderer, j, i * N / workers_num);
-#  endif
-			// Show what was drawn
-			SDL_RenderPresent(renderer);
-#endif
+			tiles->changed[i * tiles->cols + j] = changed;
 		}
 	}
+}
 
-out:
-	command = COMMAND_HALT;
-	MPI_Bcast(&command, 1, MPI_INT, 0, MPI_COMM_WORLD);
+// Calculates active tiles inside of lines x units rectangle
+// in every parts-th row of tiles starting from part
+void calculate_tiles_part(const block_s* block, tiles_s* tiles,
+                          cell_t* arena_input, cell_t* arena_output,
+                          range_s lines, range_s units, int part, int parts)
+{
+	for (int i = part; i < tiles->rows; i += parts) {
+		range_s tile_lines = {tiles->line_bounds[i], tiles->line_bounds[i + 1]};
+		if (tile_lines.begin < lines.begin)
+			tile_lines.begin = lines.begin;
+		if (tile_lines.end > lines.end)
+			tile_lines.end = lines.end;
+		if (tile_lines.begin >= tile_lines.end)
+			continue;
 
-	free(arena);
+		for (int j = 0; j < tiles->cols; j++) {
+			range_s tile_units = {tiles->unit_bounds[j], tiles->unit_bounds[j + 1]};
+			if (tile_units.begin < units.begin)
+				tile_units.begin = units.begin;
+			if (tile_units.end > units.end)
+				tile_units.end = units.end;
+			if ((tile_units.begin >= tile_units.end) ||
+			    !is_tile_active(block, tiles, i, j))
+				continue;
+
+			if (calculate_rect(block, arena_input, arena_output, tile_lines, tile_units))
+				tiles->next_changed[i * tiles->cols + j] = 1;
+		}
+	}
 }
 
-int main(int argc, char* argv[])
+void* pool_thread_func(void* arg)
 {
-	signal(SIGABRT, &graceful_abort);
-
-	MPI_Init(&argc, &argv);
+	pool_s* pool = ((struct pool_thread*)arg)->pool;
+	int index = ((struct pool_thread*)arg)->index;
 
-	int r = 0;
-	int rank = 0;
+	while (1) {
+		pthread_barrier_wait(&pool->start);
+		if (pool->stop)
+			break;
+		calculate_tiles_part(pool->block, pool->tiles,
+		                     pool->arena_input, pool->arena_output,
+		                     pool->lines, pool->units, index, pool->threads_num);
+		pthread_barrier_wait(&pool->finish);
+	}
+	return NULL;
+}
 
-	MPI_Comm_size(MPI_COMM_WORLD, &MPI_SIZE);
-	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+void pool_init(pool_s* pool, int threads_num)
+{
+	memset(pool, 0, sizeof(*pool));
+	pool->threads_num = threads_num;
+	if (threads_num == 1)
+		return;
 
-	// TODO: make N and number of random points cmd line arguments
-	if (argc != 1) {
-		if (rank == 0)
-			fprintf(stderr, "usage: %s\n", argv[0]);
-		return 1;
+	pool->threads = (pthread_t*)calloc(threads_num, sizeof(pthread_t));
+	assert(pool->threads);
+	pool->thread_args = (struct pool_thread*)calloc(threads_num, sizeof(struct pool_thread));
+	assert(pool->thread_args);
+	pthread_barrier_init(&pool->start, NULL, threads_num);
+	pthread_barrier_init(&pool->finish, NULL, threads_num);
+	// Calling thread is thread 0
+	for (int i = 1; i < threads_num; i++) {
+		pool->thread_args[i].pool = pool;
+		pool->thread_args[i].index = i;
+		int ret = pthread_create(&pool->threads[i], NULL, &pool_thread_func,
+		                         &pool->thread_args[i]);
+		assert(ret == 0);
 	}
+}
 
-	if ((N / (MPI_SIZE-1) == 0) || (N % (MPI_SIZE-1) != 0)) {
-		if (rank == 0) {
-			fprintf(stderr, "N(%d) must be divisible by (MPI_SIZE-1)(%d)\n",
-					N, MPI_SIZE-1);
-			assert((N / (MPI_SIZE-1) > 0) && (N % (MPI_SIZE-1) == 0));
-		}
-		sleep(1);
-		return 1;
+void pool_destroy(pool_s* pool)
+{
+	if (pool->threads_num == 1)
+		return;
+
+	pool->stop = 1;
+	pthread_barrier_wait(&pool->start);
+	for (int i = 1; i < pool->threads_num; i++)
+		pthread_join(pool->threads[i], NULL);
+	pthread_barrier_destroy(&pool->start);
+	pthread_barrier_destroy(&pool->finish);
+	free(pool->thread_args);
+	free(pool->threads);
+}
+
+// Rows of tiles are distributed among threads of the pool round-robin,
+// so that sparse activity is spread evenly. Tiles flags are written by
+// the only thread calculating the tile.
+void calculate_tiles(const block_s* block, tiles_s* tiles,
+                     cell_t* arena_input, cell_t* arena_output,
+                     range_s lines, range_s units)
+{
+	pool_s* pool = tiles->pool;
+	double start = MPI_Wtime();
+	if (pool->threads_num == 1) {
+		calculate_tiles_part(block, tiles, arena_input, arena_output,
+		                     lines, units, 0, 1);
+		tiles->busy_time += MPI_Wtime() - start;
+		return;
 	}
 
-	if (rank == 0) {
+	pool->block = block;
+	pool->tiles = tiles;
+	pool->arena_input = arena_input;
+	pool->arena_output = arena_output;
+	pool->lines = lines;
+	pool->units = units;
+	pthread_barrier_wait(&pool->start);
+	calculate_tiles_part(block, tiles, arena_input, arena_output,
+	                     lines, units, 0, pool->threads_num);
+	pthread_barrier_wait(&pool->finish);
+	tiles->busy_time += MPI_Wtime() - start;
+}
 
-#ifdef DRAW_WITH_SDL
-		SDL_Init(SDL_INIT_VIDEO);
-		SDL_Window* window = SDL_CreateWindow("Game of life MPI",
-		                                      SDL_WINDOWPOS_UNDEFINED,
-		                                      SDL_WINDOWPOS_UNDEFINED,
-		                                      N*SDL_SCALE, N*SDL_SCALE, SDL_WINDOW_OPENGL);
-		SDL_Renderer* renderer = SDL_CreateRenderer(window, -1,
-		                                            SDL_RENDERER_ACCELERATED |
-		                                            SDL_RENDERER_PRESENTVSYNC);
-		SDL_RenderSetScale(renderer, SDL_SCALE, SDL_SCALE);
+void tiles_next_generation(tiles_s* tiles)
+{
+	unsigned char* tmp = tiles->changed;
+	tiles->changed = tiles->next_changed;
+	tiles->next_changed = tmp;
+	memset(tiles->next_changed, 0, tiles->rows * tiles->cols);
+}
+
+// Area which has to be calculated at given step after halo
+// exchange. Cells of the halo become invalid one line per step
+// starting from its outer border, so only owned area and a margin
+// of the halo which is still needed in following steps are calculated.
+void calculated_area(const block_s* block, int step, range_s* lines, range_s* units)
+{
+	int margin_lines = block->halo_lines - 1 - step;
+#ifdef CHAR_ARENA
+	int margin_units = margin_lines;
 #else
-		void* renderer = NULL;
+	// It is cheaper to calculate whole units of halo than
+	// to track where valid cells end inside of them
+	int margin_units = margin_lines ? block->halo_units : 0;
 #endif
+	int owned_lines = block->lines.end - block->lines.begin;
+	int owned_units = block->units.end - block->units.begin;
 
-		root_func(renderer);
+	lines->begin = block->first_line - HAS_NEIGHBOR(block, DIR_N) * margin_lines;
+	lines->end   = block->first_line + owned_lines +
+	               HAS_NEIGHBOR(block, DIR_S) * margin_lines;
+	units->begin = block->first_unit - HAS_NEIGHBOR(block, DIR_W) * margin_units;
+	units->end   = block->first_unit + owned_units +
+	               HAS_NEIGHBOR(block, DIR_E) * margin_units;
+}
 
-#ifdef DRAW_WITH_SDL
-		SDL_DestroyRenderer(renderer);
-		SDL_DestroyWindow(window);
-		SDL_Quit();
-#endif
-	} else
-		worker_func(rank);
+// Step is the number of generations since last halo exchange
+// modulo HALO_DEPTH, halo of arena_input is exchanged at step 0
+void calculate_region(const block_s* block, tiles_s* tiles,
+                      cell_t* arena_input, cell_t* arena_output, int step)
+{
+	range_s lines, units;
+	calculated_area(block, step, &lines, &units);
+
+	if (step == 0) {
+		prof_switch(PROF_HALO);
+		exchange_halo(block, arena_input);
+		update_halo_tiles(block, tiles, arena_input, arena_output);
+		prof_switch(PROF_COMPUTE);
+	}
+	calculate_tiles(block, tiles, arena_input, arena_output, lines, units);
+	tiles_next_generation(tiles);
+}
+
+// Halo of arena_input is exchanged while cells which do not
+// depend on it are calculated, then the rest of the area.
+void calculate_region_overlapped(const block_s* block, tiles_s* tiles,
+                                 cell_t* arena_input, cell_t* arena_output, int step)
+{
+	if (step != 0) {
+		calculate_region(block, tiles, arena_input, arena_output, step);
+		return;
+	}
+
+	MPI_Request requests[2 * DIRECTIONS_NUM];
+	prof_switch(PROF_HALO);
+	exchange_halo_start(block, arena_input, requests);
+	prof_switch(PROF_COMPUTE);
+
+	range_s lines, units;
+	calculated_area(block, step, &lines, &units);
+	// Owned area without cells adjacent to halo
+	range_s inner_lines = {
+		block->first_line + HAS_NEIGHBOR(block, DIR_N),
+		block->first_line + block->lines.end - block->lines.begin
+		                  - HAS_NEIGHBOR(block, DIR_S)
+	};
+	range_s inner_units = {
+		block->first_unit + HAS_NEIGHBOR(block, DIR_W),
+		block->first_unit + block->units.end - block->units.begin
+		                  - HAS_NEIGHBOR(block, DIR_E)
+	};
+
+	if ((inner_lines.begin >= inner_lines.end) ||
+	    (inner_units.begin >= inner_units.end)) {
+		// Block is too thin to have any inner cells
+		prof_switch(PROF_HALO);
+		exchange_halo_finish(block, arena_input, requests);
+		update_halo_tiles(block, tiles, arena_input, arena_output);
+		prof_switch(PROF_COMPUTE);
+		calculate_tiles(block, tiles, arena_input, arena_output, lines, units);
+		tiles_next_generation(tiles);
+		return;
+	}
+
+	// Inner cells do not depend on halo, so their tiles
+	// may be chosen before halo tiles are updated
+	calculate_tiles(block, tiles, arena_input, arena_output, inner_lines, inner_units);
+	prof_switch(PROF_HALO);
+	exchange_halo_finish(block, arena_input, requests);
+	update_halo_tiles(block, tiles, arena_input, arena_output);
+	prof_switch(PROF_COMPUTE);
+
+	range_s top    = {lines.begin,     inner_lines.begin};
+	range_s bottom = {inner_lines.end, lines.end};
+	range_s left   = {units.begin,     inner_units.begin};
+	range_s right  = {inner_units.end, units.end};
+	calculate_tiles(block, tiles, arena_input, arena_output, top,         units);
+	calculate_tiles(block, tiles, arena_input, arena_output, bottom,      units);
+	calculate_tiles(block, tiles, arena_input, arena_output, inner_lines, left);
+	calculate_tiles(block, tiles, arena_input, arena_output, inner_lines, right);
+	tiles_next_generation(tiles);
+}
+
+#ifndef CHAR_ARENA
+
+// Checkpoint is the header followed by lines of the arena, each line
+// is ROW_UNITS 64-bit words in native byte order with bit j of word u
+// keeping cell u*64+j, just like workers keep it. Layout does not
+// depend on the grid of workers, so the run may be resumed with any
+// number of them.
+#define CHECKPOINT_MAGIC "LIFECKPT"
+
+typedef struct {
+	char magic[8];
+	uint64_t width, height;
+	uint64_t generation;
+	uint32_t birth, survival;
+	// Edges of the arena are glued into a torus
+	uint32_t torus;
+} checkpoint_header_s;
+
+// Owned block of the worker inside of checkpoint's arena
+MPI_Datatype checkpoint_file_type(const block_s* block)
+{
+	int sizes[2]    = {HEIGHT, ROW_UNITS};
+	int subsizes[2] = {block->lines.end - block->lines.begin,
+	                   block->units.end - block->units.begin};
+	int starts[2]   = {block->lines.begin, block->units.begin};
+	MPI_Datatype type;
+	MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C,
+	                         MPI_CELL_T, &type);
+	MPI_Type_commit(&type);
+	return type;
+}
+
+// Every worker writes its owned block directly with collective write,
+// root takes no part in it. File is written under temporary name and
+// renamed when complete, so the previous checkpoint survives a crash.
+void write_checkpoint(const block_s* block, cell_t* arena, uint64_t generation)
+{
+	char tmp_name[PATH_MAX];
+	snprintf(tmp_name, sizeof(tmp_name), "%s.tmp", CHECKPOINT_FILE_NAME);
+	int rank;
+	MPI_Comm_rank(block->comm, &rank);
+
+	MPI_File file;
+	if (MPI_File_open(block->comm, tmp_name, MPI_MODE_CREATE | MPI_MODE_WRONLY,
+	                  MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+		fprintf(stderr, "Failed to open %s\n", tmp_name);
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+	MPI_Offset size = sizeof(checkpoint_header_s) +
+	                  (MPI_Offset)HEIGHT * ROW_UNITS * sizeof(cell_t);
+	MPI_File_set_size(file, size);
+	if (rank == 0) {
+		checkpoint_header_s header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+		header.width = WIDTH;
+		header.height = HEIGHT;
+		header.generation = generation;
+		header.birth = RULE.birth;
+		header.survival = RULE.survival;
+		header.torus = TORUS;
+		MPI_File_write_at(file, 0, &header, sizeof(header), MPI_BYTE,
+		                  MPI_STATUS_IGNORE);
+	}
+
+	MPI_Datatype file_type = checkpoint_file_type(block);
+	MPI_File_set_view(file, sizeof(checkpoint_header_s), MPI_CELL_T, file_type,
+	                  "native", MPI_INFO_NULL);
+	int owned_offset = block->first_line * block->units_num + block->first_unit;
+	MPI_File_write_at_all(file, 0, &arena[owned_offset], 1, block->owned_type,
+	                      MPI_STATUS_IGNORE);
+	MPI_File_close(&file);
+	MPI_Type_free(&file_type);
+
+	if ((rank == 0) && (rename(tmp_name, CHECKPOINT_FILE_NAME) != 0)) {
+		fprintf(stderr, "Failed to rename %s\n", tmp_name);
+		MPI_Abort(MPI_COMM_WORLD, 1);
+	}
+}
+
+void read_checkpoint(const block_s* block, cell_t* arena)
+{
+	MPI_File file;
+	MPI_File_open(block->comm, RESTART_FILE_NAME, MPI_MODE_RDONLY,
+	              MPI_INFO_NULL, &file);
+	MPI_Datatype file_type = checkpoint_file_type(block);
+	MPI_File_set_view(file, sizeof(checkpoint_header_s), MPI_CELL_T, file_type,
+	                  "native", MPI_INFO_NULL);
+	int owned_offset = block->first_line * block->units_num + block->first_unit;
+	MPI_File_read_at_all(file, 0, &arena[owned_offset], 1, block->owned_type,
+	                     MPI_STATUS_IGNORE);
+	MPI_File_close(&file);
+	MPI_Type_free(&file_type);
+}
+
+// Sets arena size, generation, rule(unless it is given by -R) and
+// torus mode from the checkpoint header, called by all processes.
+// Returns 0 on success.
+int read_checkpoint_header(void)
+{
+	int rank;
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+	MPI_File file;
+	if (MPI_File_open(MPI_COMM_WORLD, RESTART_FILE_NAME, MPI_MODE_RDONLY,
+	                  MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+		if (rank == 0)
+			fprintf(stderr, "Failed to open %s\n", RESTART_FILE_NAME);
+		return 1;
+	}
+	checkpoint_header_s header;
+	MPI_File_read_at_all(file, 0, &header, sizeof(header), MPI_BYTE,
+	                     MPI_STATUS_IGNORE);
+	MPI_File_close(&file);
+
+	if (memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) ||
+	    (header.width == 0) || (header.width > INT_MAX) ||
+	    (header.height == 0) || (header.height > INT_MAX)) {
+		if (rank == 0)
+			fprintf(stderr, "%s is not a checkpoint\n", RESTART_FILE_NAME);
+		return 1;
+	}
+	WIDTH = (int)header.width;
+	HEIGHT = (int)header.height;
+	START_GENERATION = header.generation;
+	if (!RULE_STRING) {
+		RULE.birth = header.birth;
+		RULE.survival = header.survival;
+	}
+	if (header.torus)
+		TORUS = 1;
+	return 0;
+}
+
+#else // CHAR_ARENA
+
+// Checkpoints keep cells bit-packed, options
+// enabling them are rejected by parse_args
+void write_checkpoint(const block_s* block, cell_t* arena, uint64_t generation)
+{
+	assert(0);
+}
+
+void read_checkpoint(const block_s* block, cell_t* arena)
+{
+	assert(0);
+}
+
+int read_checkpoint_header(void)
+{
+	return 1;
+}
+
+#endif // CHAR_ARENA
+
+// Frames are sent as units of owned area which have changed since the
+// previous frame, XOR of the two. Encoded frame is a sequence of runs,
+// each is a header of two uint32_t: number of unchanged units to skip
+// and number of units following the header as is. Run of changed units
+// is not broken by gaps shorter than the header, so encoded frame is
+// never much bigger than the frame itself.
+#define FRAME_RUN_HEADER (2 * sizeof(uint32_t))
+#define FRAME_MIN_GAP (FRAME_RUN_HEADER / sizeof(cell_t) + 1)
+
+// Size of buffer enough to encode units_num units
+size_t encoded_frame_size(size_t units_num)
+{
+	return 2 * units_num * sizeof(cell_t) + 2 * FRAME_RUN_HEADER;
+}
+
+// Returns size of encoded frame in bytes
+int encode_frame(const cell_t* delta, size_t units_num, unsigned char* encoded)
+{
+	unsigned char* out = encoded;
+	size_t i = 0;
+	while (i < units_num) {
+		size_t first = i;
+		while ((i < units_num) && !delta[i])
+			i++;
+		if (i == units_num)
+			break;
+		size_t begin = i, end = i;
+		// Extend the run until a long enough gap
+		while ((i < units_num) && (i - end < FRAME_MIN_GAP)) {
+			if (delta[i])
+				end = i + 1;
+			i++;
+		}
+		uint32_t header[2] = {(uint32_t)(begin - first), (uint32_t)(end - begin)};
+		memcpy(out, header, sizeof(header));
+		out += sizeof(header);
+		memcpy(out, &delta[begin], (end - begin) * sizeof(cell_t));
+		out += (end - begin) * sizeof(cell_t);
+		i = end;
+	}
+	return (int)(out - encoded);
+}
+
+// Applies encoded changes to the previous frame
+void decode_frame(const unsigned char* encoded, int size, cell_t* frame)
+{
+	const unsigned char* in = encoded;
+	while (in < encoded + size) {
+		uint32_t header[2];
+		memcpy(header, in, sizeof(header));
+		in += sizeof(header);
+		frame += header[0];
+		for (uint32_t i = 0; i < header[1]; i++) {
+			cell_t delta;
+			memcpy(&delta, in, sizeof(delta));
+			in += sizeof(delta);
+			*frame++ ^= delta;
+		}
+	}
+}
+
+// Arena state is collected after these iterations
+int is_frame_iteration(int iter_num)
+{
+	return (iter_num % ITERATIONS_PER_FRAME == 0) || (iter_num == ITER_NUM);
+}
+
+// Lines are rebalanced after these iterations, root and all workers
+// are at the same frame then and halo is about to be exchanged
+int is_balance_iteration(int iter_num, int prev_balance_iter_num)
+{
+	return BALANCE_PERIOD && (GRID[0] > 1) && (iter_num < ITER_NUM) &&
+	       is_frame_iteration(iter_num) && (iter_num % HALO_DEPTH == 0) &&
+	       (iter_num - prev_balance_iter_num >= BALANCE_PERIOD);
+}
+
+// Calculation times of all workers are gathered by root and every
+// worker, each of them moves the same boundaries. Collective over
+// LIFE_COMM, root passes 0. Returns whether any boundary has moved.
+int balance(double busy_time)
+{
+	int size;
+	MPI_Comm_size(LIFE_COMM, &size);
+	double* times = (double*)calloc(size, sizeof(double));
+	assert(times);
+	MPI_Allgather(&busy_time, 1, MPI_DOUBLE, times, 1, MPI_DOUBLE, LIFE_COMM);
+	int moved = balance_lines(&times[1]);
+	free(times);
+	return moved;
+}
+
+// Lines of the previous owned area which are owned by the block now
+// are copied from arena, the rest are exchanged with vertical
+// neighbors. Returns new arena with owned area filled.
+cell_t* migrate_lines(const block_s* prev, const cell_t* arena, const block_s* block)
+{
+	int units = block->units.end - block->units.begin;
+	cell_t* new_arena = (cell_t*)calloc(block->lines_num * block->units_num,
+	                                    sizeof(cell_t));
+	assert(new_arena);
+	int begin = (prev->lines.begin > block->lines.begin) ? prev->lines.begin
+	                                                     : block->lines.begin;
+	int end = (prev->lines.end < block->lines.end) ? prev->lines.end : block->lines.end;
+	for (int line = begin; line < end; line++)
+		memcpy(&new_arena[(block->first_line + line - block->lines.begin) *
+		                  block->units_num + block->first_unit],
+		       &arena[(prev->first_line + line - prev->lines.begin) *
+		              prev->units_num + prev->first_unit],
+		       units * sizeof(cell_t));
+
+	// Lines [first, last) go to(come from) the neighbor, message
+	// is tagged with direction it is sent in
+	struct {
+		int first, last, dir, is_recv;
+	} moves[2] = {
+		{prev->lines.begin,  block->lines.begin, DIR_N, 0},
+		{block->lines.end,   prev->lines.end,    DIR_S, 0},
+	};
+	MPI_Request requests[2];
+	MPI_Datatype types[2];
+	for (int i = 0; i < 2; i++) {
+		if (moves[i].first > moves[i].last) {
+			int tmp = moves[i].first;
+			moves[i].first = moves[i].last;
+			moves[i].last = tmp;
+			moves[i].is_recv = 1;
+		}
+		requests[i] = MPI_REQUEST_NULL;
+		types[i] = MPI_DATATYPE_NULL;
+		if (moves[i].first == moves[i].last)
+			continue;
+		MPI_Type_vector(moves[i].last - moves[i].first, units, block->units_num,
+		                MPI_CELL_T, &types[i]);
+		MPI_Type_commit(&types[i]);
+		int neighbor = block->neighbors[moves[i].dir];
+		if (moves[i].is_recv)
+			MPI_Irecv(&new_arena[(block->first_line + moves[i].first - block->lines.begin) *
+			                     block->units_num + block->first_unit],
+			          1, types[i], neighbor, moves[i].dir ^ 1, block->comm, &requests[i]);
+		else
+			MPI_Isend(&arena[(prev->first_line + moves[i].first - prev->lines.begin) *
+			                 prev->units_num + prev->first_unit],
+			          1, types[i], neighbor, moves[i].dir, block->comm, &requests[i]);
+	}
+	MPI_Waitall(2, requests, MPI_STATUSES_IGNORE);
+	for (int i = 0; i < 2; i++)
+		if (types[i] != MPI_DATATYPE_NULL)
+			MPI_Type_free(&types[i]);
+	return new_arena;
+}
+
+void worker_func(MPI_Comm workers_comm, int rank)
+{
+	block_s block;
+	block_init(&block, workers_comm, rank);
+	pool_s pool;
+	pool_init(&pool, THREADS_NUM);
+	tiles_s tiles;
+	tiles_init(&tiles, &block, &pool);
+	int size = block.lines_num * block.units_num;
+	int owned_offset = block.first_line * block.units_num + block.first_unit;
+	int owned_lines = block.lines.end - block.lines.begin;
+	int owned_units = block.units.end - block.units.begin;
+
+	// One is for current iteration, another is for the next
+	cell_t* arena1 = (cell_t*)calloc(size, sizeof(cell_t));
+	assert(arena1);
+	cell_t* arena2 = (cell_t*)calloc(size, sizeof(cell_t));
+	assert(arena2);
+	// Owned area as it was sent to root at the previous frame,
+	// and its changes being sent now
+	cell_t* frame = (cell_t*)calloc(owned_lines * owned_units, sizeof(cell_t));
+	assert(frame);
+	cell_t* frame_delta = (cell_t*)calloc(owned_lines * owned_units, sizeof(cell_t));
+	assert(frame_delta);
+	unsigned char* encoded_frame =
+		(unsigned char*)malloc(encoded_frame_size(owned_lines * owned_units));
+	assert(encoded_frame);
+	int encoded_size = 0;
+
+	cell_t* arena_input  = arena1;
+	cell_t* arena_output = arena2;
+	cell_t* tmp = NULL;
+
+	if (RESTART_FILE_NAME)
+		read_checkpoint(&block, arena_input);
+	else
+		MPI_Recv(&arena_input[owned_offset], 1, block.owned_type,
+		         0, 0, LIFE_COMM, MPI_STATUS_IGNORE);
+	if (PROFILE)
+		prof_start(LIFE_COMM, TRACE_FILE_NAME != NULL);
+
+	// Frame is gathered and root's command is received in
+	// background, they are waited for at the next frame only
+	MPI_Request frame_requests[3] = {
+		MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL
+	};
+	int command = COMMAND_CONTINUE;
+	int iter_num = 0, checkpoint_iter_num = 0, balance_iter_num = 0;
+	while (iter_num < ITER_NUM) {
+		prof_generation(START_GENERATION + iter_num);
+		prof_switch(PROF_COMPUTE);
+		// Calculate
+		int step = iter_num % HALO_DEPTH;
+		if (OVERLAP_EXCHANGE)
+			calculate_region_overlapped(&block, &tiles, arena_input, arena_output, step);
+		else
+			calculate_region(&block, &tiles, arena_input, arena_output, step);
+		// Exchange values of arena_input, arena_output pointers
+		tmp = arena_input; arena_input = arena_output; arena_output = tmp;
+		iter_num++;
+
+		if (CHECKPOINT_FILE_NAME && (iter_num % CHECKPOINT_PERIOD == 0)) {
+			prof_switch(PROF_CHECKPOINT);
+			write_checkpoint(&block, arena_input, START_GENERATION + iter_num);
+			checkpoint_iter_num = iter_num;
+		}
+
+		if (!is_frame_iteration(iter_num))
+			continue;
+		prof_switch(PROF_ROOT_WAIT);
+		MPI_Waitall(3, frame_requests, MPI_STATUSES_IGNORE);
+		if (command == COMMAND_HALT)
+			break;
+		assert(command < COMMAND_INVALID && command >= 0);
+		prof_switch(PROF_SEND);
+		// Send changes since the previous frame back, root gets
+		// their sizes first to know where to put them. Frames are
+		// empty if root does not draw them.
+		encoded_size = 0;
+		if (root_draws()) {
+			for (int i = 0; i < owned_lines; i++) {
+				const cell_t* line = &arena_input[owned_offset + i * block.units_num];
+				cell_t* shown = &frame[i * owned_units];
+				cell_t* delta = &frame_delta[i * owned_units];
+				for (int j = 0; j < owned_units; j++) {
+					delta[j] = line[j] ^ shown[j];
+					shown[j] = line[j];
+				}
+			}
+			encoded_size = encode_frame(frame_delta, owned_lines * owned_units,
+			                            encoded_frame);
+		}
+		MPI_Igather(&encoded_size, 1, MPI_INT, NULL, 0, MPI_INT,
+		            0, LIFE_COMM, &frame_requests[0]);
+		MPI_Igatherv(encoded_frame, encoded_size, MPI_BYTE,
+		             NULL, NULL, NULL, MPI_BYTE,
+		             0, LIFE_COMM, &frame_requests[1]);
+		MPI_Ibcast(&command, 1, MPI_INT, 0, LIFE_COMM, &frame_requests[2]);
+
+		if (!is_balance_iteration(iter_num, balance_iter_num))
+			continue;
+		prof_switch(PROF_BALANCE);
+		// Frame is about to be reallocated, and root
+		// does not rebalance if it has halted simulation
+		MPI_Waitall(3, frame_requests, MPI_STATUSES_IGNORE);
+		if (command == COMMAND_HALT)
+			continue;
+		balance_iter_num = iter_num;
+		int moved = balance(tiles.busy_time);
+		tiles.busy_time = 0.0;
+		if (!moved)
+			continue;
+
+		block_s prev = block;
+		block_init(&block, workers_comm, rank);
+		cell_t* arena = migrate_lines(&prev, arena_input, &block);
+		block_destroy(&prev);
+		free(arena1);
+		free(arena2);
+		free(frame);
+		free(frame_delta);
+		free(encoded_frame);
+		size = block.lines_num * block.units_num;
+		owned_offset = block.first_line * block.units_num + block.first_unit;
+		owned_lines = block.lines.end - block.lines.begin;
+		arena1 = arena;
+		arena2 = (cell_t*)calloc(size, sizeof(cell_t));
+		assert(arena2);
+		// Root forgets previous frames too, the next one is sent whole
+		frame = (cell_t*)calloc(owned_lines * owned_units, sizeof(cell_t));
+		assert(frame);
+		frame_delta = (cell_t*)calloc(owned_lines * owned_units, sizeof(cell_t));
+		assert(frame_delta);
+		encoded_frame =
+			(unsigned char*)malloc(encoded_frame_size(owned_lines * owned_units));
+		assert(encoded_frame);
+		arena_input  = arena1;
+		arena_output = arena2;
+		// Output arena holds nothing, so all tiles are calculated
+		tiles_destroy(&tiles);
+		tiles_init(&tiles, &block, &pool);
+	}
+	prof_switch(PROF_ROOT_WAIT);
+	MPI_Waitall(3, frame_requests, MPI_STATUSES_IGNORE);
+	// Workers stop at the same iteration, halted or not
+	if (CHECKPOINT_FILE_NAME && (checkpoint_iter_num != iter_num)) {
+		prof_switch(PROF_CHECKPOINT);
+		write_checkpoint(&block, arena_input, START_GENERATION + iter_num);
+	}
+	if (BENCHMARK) {
+		uint64_t counts[2];
+		count_cells(&block, arena_input, counts);
+		MPI_Reduce(counts, NULL, 2, MPI_UINT64_T, MPI_SUM, 0, LIFE_COMM);
+	}
+	prof_stop();
+	if (PROFILE)
+		prof_report(stdout, TRACE_FILE_NAME);
+
+	free(encoded_frame);
+	free(frame_delta);
+	free(frame);
+	free(arena1);
+	free(arena2);
+	tiles_destroy(&tiles);
+	pool_destroy(&pool);
+	block_destroy(&block);
+}
+
+// Converts block in the representation used by workers(stored
+// contiguously, line after line) into cells of the arena
+void unpack_block(const cell_t* block, char* arena, range_s lines, range_s units)
+{
+	int units_num = units.end - units.begin;
+	for (int i = lines.begin; i < lines.end; i++) {
+		const cell_t* line = &block[(i - lines.begin) * units_num];
+#ifdef CHAR_ARENA
+		memcpy(&arena[(size_t)i * WIDTH + units.begin], line, units_num);
+#else
+		int end = (units.end * 64 < WIDTH) ? units.end * 64 : WIDTH;
+		for (int j = units.begin * 64; j < end; j++) {
+			int alive = (line[j / 64 - units.begin] >> (j % 64)) & 1;
+			size_t idx = (size_t)i * WIDTH + j;
+#  ifdef COLORED_CELLS
+			// Packed arena has no room for cell age, so
+			// age cells here in the same way char workers do
+			unsigned char age = arena[idx];
+			arena[idx] = alive * (age + 12 * (age != 253));
+#  else
+			arena[idx] = alive;
+#  endif
+		}
+#endif
+	}
+}
+
+// Calls set_cell for every live cell of the initial pattern, line after line
+void read_pattern(void (*set_cell)(void* ctx, int64_t line, int64_t col), void* ctx)
+{
+	if (DENSITY > 0.0) {
+		// Random numbers are taken line after line, cell after cell
+		uint64_t state = SEED;
+		for (int i = 0; i < HEIGHT; i++)
+			for (int j = 0; j < WIDTH; j++)
+				if ((next_random(&state) >> 11) * 0x1.0p-53 < DENSITY)
+					set_cell(ctx, i, j);
+		return;
+	}
+	if (RLE_FILE_NAME == NULL) {
+		struct {
+			int y, x;
+		} points[] = {
+			// Glider
+			{1, 2},
+			{2, 3},
+			{3, 1},
+			{3, 2},
+			{3, 3},
+			// Blinker
+			{2, 9},
+			{2, 10},
+			{2, 11},
+		};
+		for (int i = 0; i < sizeof(points)/sizeof(points[0]); i++)
+			set_cell(ctx, points[i].y, points[i].x);
+		return;
+	}
+
+	pattern_info_s info;
+	if (pattern_read(RLE_FILE_NAME, &info, set_cell, ctx) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+// Root decodes the pattern line after line and sends blocks of a row
+// of the grid to workers as soon as all lines of the row are decoded,
+// so it never keeps more than two rows of the grid.
+typedef struct {
+	int row;
+	range_s lines;
+	// Lines of the row in workers' representation
+	cell_t* strip;
+	// Blocks of the previous row being sent, one after another
+	cell_t* blocks;
+	MPI_Request* requests;
+	// Initial state is unpacked here if it is not NULL
+	char* arena;
+} strip_sender_s;
+
+void send_strip(strip_sender_s* sender)
+{
+	range_s lines = sender->lines;
+	MPI_Waitall(GRID[1], sender->requests, MPI_STATUSES_IGNORE);
+
+	size_t offset = 0;
+	for (int j = 0; j < GRID[1]; j++) {
+		int i = sender->row * GRID[1] + j;
+		range_s units = zone_units(i);
+		int units_num = units.end - units.begin;
+		cell_t* block = &sender->blocks[offset];
+		for (int l = lines.begin; l < lines.end; l++)
+			memcpy(&block[(l - lines.begin) * units_num],
+			       &sender->strip[(size_t)(l - lines.begin) * ROW_UNITS + units.begin],
+			       units_num * sizeof(cell_t));
+		if (sender->arena)
+			unpack_block(block, sender->arena, lines, units);
+
+		int count = (lines.end - lines.begin) * units_num;
+		MPI_Isend(block, count, MPI_CELL_T, i + 1, 0, LIFE_COMM, &sender->requests[j]);
+		offset += count;
+	}
+
+	memset(sender->strip, 0, (size_t)(lines.end - lines.begin) * ROW_UNITS * sizeof(cell_t));
+	sender->row++;
+	if (sender->row < GRID[0])
+		sender->lines = zone_lines(sender->row * GRID[1]);
+}
+
+// Cells which do not fit into the arena are dropped
+void set_strip_cell(void* sender_arg, int64_t line, int64_t col)
+{
+	strip_sender_s* sender = (strip_sender_s*)sender_arg;
+	if ((line >= HEIGHT) || (col >= WIDTH))
+		return;
+	while (line >= sender->lines.end)
+		send_strip(sender);
+
+	cell_t* strip_line = &sender->strip[(size_t)(line - sender->lines.begin) * ROW_UNITS];
+#ifdef CHAR_ARENA
+	strip_line[col] = 1;
+#else
+	strip_line[col / 64] |= (uint64_t)1 << (col % 64);
+#endif
+}
+
+void distribute_pattern(char* arena)
+{
+	// The first row of the grid is the highest one
+	size_t strip_size = (size_t)(zone_lines(0).end - zone_lines(0).begin) * ROW_UNITS;
+
+	strip_sender_s sender;
+	sender.row = 0;
+	sender.lines = zone_lines(0);
+	sender.arena = arena;
+	sender.strip = (cell_t*)calloc(strip_size, sizeof(cell_t));
+	assert(sender.strip);
+	sender.blocks = (cell_t*)calloc(strip_size, sizeof(cell_t));
+	assert(sender.blocks);
+	sender.requests = (MPI_Request*)calloc(GRID[1], sizeof(MPI_Request));
+	assert(sender.requests);
+	for (int j = 0; j < GRID[1]; j++)
+		sender.requests[j] = MPI_REQUEST_NULL;
+
+	read_pattern(&set_strip_cell, &sender);
+	while (sender.row < GRID[0])
+		send_strip(&sender);
+	MPI_Waitall(GRID[1], sender.requests, MPI_STATUSES_IGNORE);
+
+	free(sender.requests);
+	free(sender.blocks);
+	free(sender.strip);
+}
+
+#ifdef DRAW_WITH_SDL
+// Frames are drawn by a thread of their own, so that root gathers
+// the next frame while the previous one is drawn. The thread makes
+// all SDL calls and no MPI calls. Each frame is built in pixels of
+// a streaming texture and uploaded at once.
+typedef struct {
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	// Copy of the arena and of LINE_BOUNDS, owned by
+	// the thread while the frame is pending
+	char* arena;
+	int* line_bounds;
+	int pending;
+	// Window has been closed
+	int quit;
+	// Set by root when simulation ends
+	int stop;
+} renderer_s;
+
+// Colors of a pixel, ARGB8888
+#define PIXEL(R, G, B) \
+	(0xff000000u | ((uint32_t)(R) << 16) | ((uint32_t)(G) << 8) | (uint32_t)(B))
+
+void draw_arena(const renderer_s* r, uint32_t* pixels, int pitch)
+{
+	for (int i = 0; i < HEIGHT; i++) {
+		uint32_t* line = (uint32_t*)((char*)pixels + (size_t)i * pitch);
+		const unsigned char* cells = (const unsigned char*)&r->arena[(size_t)i * WIDTH];
+		for (int j = 0; j < WIDTH; j++) {
+#ifdef COLORED_CELLS
+			line[j] = cells[j] ? PIXEL(0, 255 - cells[j], cells[j]) : PIXEL(0, 0, 0);
+#else
+			line[j] = cells[j] ? PIXEL(255, 255, 255) : PIXEL(0, 0, 0);
+#endif
+		}
+	}
+#ifdef SHOW_WORKERS_BORDERS
+	for (int i = 0; i < GRID[0]; i++) {
+		uint32_t* line = (uint32_t*)((char*)pixels + (size_t)r->line_bounds[i] * pitch);
+		for (int j = 0; j < WIDTH; j++)
+			line[j] = PIXEL(255, 0, 0);
+	}
+	for (int i = 0; i < GRID[1]; i++) {
+		int col = zone_units(i).begin * CELLS_PER_UNIT;
+		for (int j = 0; j < HEIGHT; j++)
+			((uint32_t*)((char*)pixels + (size_t)j * pitch))[col] = PIXEL(255, 0, 0);
+	}
+#endif
+}
+
+void* renderer_thread_func(void* arg)
+{
+	renderer_s* r = (renderer_s*)arg;
+	SDL_Init(SDL_INIT_VIDEO);
+	SDL_Window* window = SDL_CreateWindow("Game of life MPI",
+	                                      SDL_WINDOWPOS_UNDEFINED,
+	                                      SDL_WINDOWPOS_UNDEFINED,
+	                                      WIDTH*SDL_SCALE, HEIGHT*SDL_SCALE, SDL_WINDOW_OPENGL);
+	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1,
+	                                            SDL_RENDERER_ACCELERATED |
+	                                            SDL_RENDERER_PRESENTVSYNC);
+	// Texture is stretched over the window, cells stay sharp
+	SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "nearest");
+	SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+	                                         SDL_TEXTUREACCESS_STREAMING,
+	                                         WIDTH, HEIGHT);
+
+	pthread_mutex_lock(&r->mutex);
+	// The last frame is drawn before exit
+	while (!r->stop || r->pending) {
+		if (r->pending) {
+			pthread_mutex_unlock(&r->mutex);
+			void* pixels;
+			int pitch;
+			if (SDL_LockTexture(texture, NULL, &pixels, &pitch) == 0) {
+				draw_arena(r, (uint32_t*)pixels, pitch);
+				SDL_UnlockTexture(texture);
+			}
+			SDL_RenderClear(renderer);
+			SDL_RenderCopy(renderer, texture, NULL, NULL);
+			SDL_RenderPresent(renderer);
+			pthread_mutex_lock(&r->mutex);
+			r->pending = 0;
+			pthread_cond_broadcast(&r->cond);
+		}
+
+		SDL_Event event;
+		while (SDL_PollEvent(&event))
+			if (event.type == SDL_QUIT)
+				r->quit = 1;
+		// Window has to respond to events between frames
+		if (!r->pending && !r->stop) {
+			struct timespec deadline;
+			clock_gettime(CLOCK_REALTIME, &deadline);
+			deadline.tv_nsec += 10 * 1000 * 1000;
+			if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+				deadline.tv_sec++;
+				deadline.tv_nsec -= 1000 * 1000 * 1000;
+			}
+			pthread_cond_timedwait(&r->cond, &r->mutex, &deadline);
+		}
+	}
+	pthread_mutex_unlock(&r->mutex);
+
+	SDL_DestroyTexture(texture);
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	return NULL;
+}
+
+void renderer_start(renderer_s* r)
+{
+	r->arena = (char*)calloc((size_t)WIDTH * HEIGHT, sizeof(char));
+	assert(r->arena);
+	r->line_bounds = (int*)calloc(GRID[0] + 1, sizeof(int));
+	assert(r->line_bounds);
+	r->pending = r->quit = r->stop = 0;
+	pthread_mutex_init(&r->mutex, NULL);
+	pthread_cond_init(&r->cond, NULL);
+	pthread_create(&r->thread, NULL, &renderer_thread_func, r);
+}
+
+void renderer_stop(renderer_s* r)
+{
+	pthread_mutex_lock(&r->mutex);
+	r->stop = 1;
+	pthread_cond_broadcast(&r->cond);
+	pthread_mutex_unlock(&r->mutex);
+	pthread_join(r->thread, NULL);
+	pthread_cond_destroy(&r->cond);
+	pthread_mutex_destroy(&r->mutex);
+	free(r->line_bounds);
+	free(r->arena);
+}
+
+// Hands the arena over to the thread once it is done with the previous
+// frame. Returns whether the window has been closed.
+int render_arena(renderer_s* r, const char* arena)
+{
+	pthread_mutex_lock(&r->mutex);
+	while (r->pending)
+		pthread_cond_wait(&r->cond, &r->mutex);
+	memcpy(r->arena, arena, (size_t)WIDTH * HEIGHT);
+	memcpy(r->line_bounds, LINE_BOUNDS, (GRID[0] + 1) * sizeof(int));
+	r->pending = 1;
+	pthread_cond_broadcast(&r->cond);
+	int quit = r->quit;
+	pthread_mutex_unlock(&r->mutex);
+	return quit;
+}
+#endif
+
+// Prints a line of
+//   workers width height generations time cells_per_second population checksum
+// where population and checksum are reduced from count_cells() of
+// workers, so results of runs with any number of workers may be compared
+void print_benchmark(int generations, double time)
+{
+	uint64_t zeros[2] = {0, 0}, counts[2];
+	MPI_Reduce(zeros, counts, 2, MPI_UINT64_T, MPI_SUM, 0, LIFE_COMM);
+	printf("%d %d %d %d %.6f %.6e %llu %016llx\n",
+	       WORKERS_NUM, WIDTH, HEIGHT, generations, time,
+	       (double)WIDTH * HEIGHT * generations / time,
+	       (unsigned long long)counts[0], (unsigned long long)counts[1]);
+	fflush(stdout);
+}
+
+// Where owned area of each worker is put by frame gather,
+// index i + 1 is for worker i
+void frame_layout(int* counts, int* displs)
+{
+	for (int i = 0; i < WORKERS_NUM; i++) {
+		range_s lines = zone_lines(i);
+		range_s units = zone_units(i);
+		counts[i + 1] = (lines.end - lines.begin) * (units.end - units.begin);
+		displs[i + 1] = displs[i] + counts[i];
+	}
+}
+
+void root_func(void* renderer_arg)
+{
+	// Arena and blocks are only kept to be drawn
+	char* arena = NULL;
+	cell_t* blocks = NULL;
+	if (root_draws()) {
+		arena = (char*)calloc((size_t)WIDTH * HEIGHT, sizeof(char));
+		assert(arena);
+		// Owned areas of all workers in workers' representation, one
+		// after another, as of the previous frame. Root itself owns nothing.
+		blocks = (cell_t*)calloc((size_t)HEIGHT * ROW_UNITS, sizeof(cell_t));
+		assert(blocks);
+	}
+
+	int workers_num = WORKERS_NUM;
+
+	int* counts = (int*)calloc(workers_num + 1, sizeof(int));
+	assert(counts);
+	int* displs = (int*)calloc(workers_num + 1, sizeof(int));
+	assert(displs);
+	frame_layout(counts, displs);
+	// Encoded changes of the blocks gathered at each frame
+	int* encoded_sizes = (int*)calloc(workers_num + 1, sizeof(int));
+	assert(encoded_sizes);
+	int* encoded_displs = (int*)calloc(workers_num + 1, sizeof(int));
+	assert(encoded_displs);
+	size_t encoded_capacity = 0;
+	unsigned char* encoded = NULL;
+	/* ARENA scheme
+	 *
+	 * Numbers in brackets correspond to ranks of
+	 * processes responsible for areas.
+	 *
+	 * Cells marked as = and | are halo, i.e. owned
+	 * by neighbors and stored in order to calculate
+	 * cells on the border of the block. Halo is
+	 * exchanged with all 8 neighbors after each step.
+	 *
+	 * Root process only sends initial areas' values, then
+	 * workers calculate generations on their own. Every
+	 * ITERATIONS_PER_FRAME generations root gathers arena
+	 * state and broadcasts 'continue' or 'halt' message in
+	 * order to continue or stop simulation.
+	 *
+	 * workers_num = 6, GRID = 3x2, HEIGHT = 11
+	 * HEIGHT % GRID[0] = 2 first rows of the grid own one extra line,
+	 * units of each line are divided among columns of the grid in
+	 * the same way. Stored block of worker (4) is shown.
+	 *
+	 *                WIDTH
+	 *     |<----------------------->|
+	 *     |                         |
+	 *
+	 *     +------------+------------+ ---
+	 *    0|            |            |   ^
+	 *    1|     (1)    |     (2)    |   | HEIGHT / GRID[0] + 1 = 4
+	 *    2|            |            |   |
+	 *    3|           =|============|   V
+	 *     +------------+------------+ ---
+	 *    4|           ||     (4)    |
+	 *    5|     (3)   ||            |
+	 *    6|           ||            |
+	 *    7|           =|============|
+	 *     +------------+------------+
+	 *    8|            |            |
+	 *    9|     (5)    |     (6)    |
+	 *   10|            |            |
+	 *     +------------+------------+
+	 */
+
+	// Send initial arena state to workers. Each worker
+	// receives owned area only and gets halo from neighbors.
+	// When resumed, workers read it from the checkpoint.
+	if (!RESTART_FILE_NAME) {
+		distribute_pattern(arena);
+		dump_arena_state(arena);
+	}
+	if (PROFILE)
+		prof_start(LIFE_COMM, TRACE_FILE_NAME != NULL);
+
+	int command = COMMAND_CONTINUE;
+
+	int fps = 0, prev_iter_num = 0, balance_iter_num = 0, frame_iter_num = 0;
+	double prev_time = MPI_Wtime();
+	double start_time = prev_time;
+
+	fprintf(stderr, "\n");
+	for (int iter_num = 0; iter_num < ITER_NUM; ) {
+		// Workers send frames after these iterations only
+		do {
+			iter_num++;
+		} while (!is_frame_iteration(iter_num));
+
+		MPI_Request request;
+		int no_changes = 0;
+		MPI_Igather(&no_changes, 1, MPI_INT, encoded_sizes, 1, MPI_INT,
+		            0, LIFE_COMM, &request);
+		MPI_Wait(&request, MPI_STATUS_IGNORE);
+		size_t encoded_size = 0;
+		for (int i = 0; i < workers_num; i++) {
+			encoded_displs[i + 1] = encoded_displs[i] + encoded_sizes[i];
+			encoded_size = encoded_displs[i + 1] + encoded_sizes[i + 1];
+		}
+		if (encoded_size > encoded_capacity) {
+			encoded_capacity = 2 * encoded_size;
+			encoded = (unsigned char*)realloc(encoded, encoded_capacity);
+			assert(encoded);
+		}
+		MPI_Igatherv(NULL, 0, MPI_BYTE,
+		             encoded, encoded_sizes, encoded_displs, MPI_BYTE,
+		             0, LIFE_COMM, &request);
+		MPI_Wait(&request, MPI_STATUS_IGNORE);
+		for (int i = 0; arena && (i < workers_num); i++) {
+			decode_frame(&encoded[encoded_displs[i + 1]], encoded_sizes[i + 1],
+			             &blocks[displs[i + 1]]);
+			unpack_block(&blocks[displs[i + 1]], arena, zone_lines(i), zone_units(i));
+		}
+
+		frame_iter_num = iter_num;
+
+		// Show data
+		dump_arena_state(arena);
+#ifdef DRAW_WITH_SDL
+		if (arena && render_arena((renderer_s*)renderer_arg, arena))
+			command = COMMAND_HALT;
+#endif
+		// Update fps
+		if (iter_num - prev_iter_num >= ITERATIONS_PER_FPS_UPDATE) {
+			double cur_time = MPI_Wtime();
+			fps = (iter_num - prev_iter_num) / (cur_time - prev_time);
+			prev_time = cur_time;
+			prev_iter_num = iter_num;
+		}
+		// Print iteration number and fps
+		if (!BENCHMARK)
+			fprintf(stderr, "\riteration %3d, fps %3d", iter_num, fps);
+
+		// Send command to processes, they will get it
+		// when they are done with the next frame
+		MPI_Ibcast(&command, 1, MPI_INT, 0, LIFE_COMM, &request);
+		MPI_Wait(&request, MPI_STATUS_IGNORE);
+		if (command == COMMAND_HALT)
+			break;
+
+		// Frames are gathered according to updated zones from now on
+		if (is_balance_iteration(iter_num, balance_iter_num)) {
+			balance_iter_num = iter_num;
+			if (balance(0.0)) {
+				// Workers send the next frame whole
+				frame_layout(counts, displs);
+				if (blocks)
+					memset(blocks, 0, (size_t)HEIGHT * ROW_UNITS * sizeof(cell_t));
+			}
+		}
+	}
+	if (BENCHMARK)
+		print_benchmark(frame_iter_num, MPI_Wtime() - start_time);
+	if (PROFILE)
+		prof_report(stdout, TRACE_FILE_NAME);
+
+	free(encoded);
+	free(encoded_displs);
+	free(encoded_sizes);
+	free(displs);
+	free(counts);
+	free(blocks);
+	free(arena);
+}
+
+void set_hashlife_cell(void* universe, int64_t line, int64_t col)
+{
+	hl_set_cell((hl_universe_s*)universe, col, line);
+}
+
+void hashlife_func(void)
+{
+	if (RULE.birth & 1) {
+		fprintf(stderr, "Hashlife does not support rules with B0\n");
+		return;
+	}
+	hl_universe_s universe;
+	hl_init(&universe, HASHLIFE_MAX_NODES);
+	hl_set_rule(&universe, RULE.birth, RULE.survival);
+	pattern_info_s info;
+	if (RLE_FILE_NAME == NULL)
+		read_pattern(&set_hashlife_cell, &universe);
+	else if (pattern_read_universe(RLE_FILE_NAME, &info, &universe) != 0)
+		MPI_Abort(MPI_COMM_WORLD, 1);
+
+	double start = MPI_Wtime();
+	if (hl_advance(&universe, HASHLIFE_GENERATIONS) != 0)
+		fprintf(stderr, "Pattern has outgrown Hashlife plane, stopped\n");
+	double time = MPI_Wtime() - start;
+
+	int64_t x0, y0, x1, y1;
+	printf("Generation %llu: population %llu",
+	       (unsigned long long)universe.generation,
+	       (unsigned long long)hl_population(&universe));
+	if (hl_bounding_box(&universe, &x0, &y0, &x1, &y1))
+		printf(", bounding box (%lld, %lld) - (%lld, %lld)",
+		       (long long)x0, (long long)y0, (long long)x1, (long long)y1);
+	printf("\n");
+	printf("Time %lf s, %zu nodes, %zu collections\n",
+	       time, universe.nodes_num, universe.collections_num);
+	hl_destroy(&universe);
+}
+
+int read_int(const char* str, int* res)
+{
+	long val;
+	char* endptr;
+	val = strtol(str, &endptr, 10);
+	if ((*str == '\0') || (*endptr != '\0')) {
+		fprintf(stderr, "Failed to convert '%s' to integer\n", str);
+		return 1;
+	}
+	if ((val <= 0) || (val > INT_MAX)) {
+		fprintf(stderr, "Argument shall be positive integer(val = %ld)\n", val);
+		return 1;
+	}
+	*res = (int)val;
+	return 0;
+}
+
+int read_uint64(const char* str, uint64_t* res)
+{
+	unsigned long long val;
+	char* endptr;
+	val = strtoull(str, &endptr, 10);
+	if ((*str == '\0') || (*str == '-') || (*endptr != '\0') || (val == 0)) {
+		fprintf(stderr, "Argument shall be positive integer('%s')\n", str);
+		return 1;
+	}
+	*res = (uint64_t)val;
+	return 0;
+}
+
+// Rule is parsed from -R, or from the pattern file's header read by
+// root. Called by all processes. Returns 0 on success.
+int set_rule(int rank)
+{
+	char rule[PATTERN_RULE_LEN] = "";
+	if (RULE_STRING) {
+		snprintf(rule, sizeof(rule), "%s", RULE_STRING);
+	} else if (RLE_FILE_NAME && !RESTART_FILE_NAME) {
+		pattern_info_s info;
+		if ((rank == 0) && (pattern_read_info(RLE_FILE_NAME, &info) == 0))
+			memcpy(rule, info.rule, sizeof(rule));
+		MPI_Bcast(rule, sizeof(rule), MPI_CHAR, 0, MPI_COMM_WORLD);
+	}
+
+	if (rule[0] && (pattern_parse_rule(rule, &RULE) != 0)) {
+		if (rank == 0)
+			fprintf(stderr, "Invalid rule '%s'\n", rule);
+		return 1;
+	}
+#ifndef CHAR_ARENA
+	select_rule_kernel();
+#endif
+	return 0;
+}
+
+void print_usage(const char* name)
+{
+	fprintf(stderr,
+		"usage: %s [-w width] [-h height] [-i iterations] [-f rle_file] [-n workers]"
+		" [-g rowsxcols] [-t threads] [-T] [-o] [-k halo_depth] [-r frame_interval]"
+#ifdef DRAW_WITH_SDL
+		" [-s sdl_scale]"
+#endif
+#ifndef CHAR_ARENA
+		" [-c checkpoint_file] [-p checkpoint_period] [-l checkpoint_file]"
+#endif
+		" [-R rule] [-H generations] [-m] [-M trace_file] [-b balance_period]"
+		" [-d density] [-S seed] [-B]\n"
+		"  -w, -h  dimensions of the arena(default %dx%d)\n"
+		"  -i      number of iterations to simulate(default %d)\n"
+		"  -f      RLE, plaintext or macrocell file with initial pattern\n"
+		"          (default glider and blinker)\n"
+		"  -n      number of worker processes(default MPI_SIZE - 1)\n"
+		"  -g      grid of workers, e.g. 4x2(default is chosen by MPI_Dims_create)\n"
+		"  -t      threads calculating block of each worker(default %d)\n"
+		"  -T      wrap lines and columns of the arena around\n"
+		"  -o      overlap halo exchange with calculation\n"
+		"  -k      exchange halo of k lines once per k iterations(default 1)\n"
+		"  -r      show arena state once per r iterations(default 1)\n"
+#ifndef CHAR_ARENA
+		"  -c      write checkpoint into the file when simulation ends\n"
+		"  -p      also write checkpoint once per p iterations\n"
+		"  -l      resume simulation from checkpoint, arena size and\n"
+		"          pattern are taken from it\n"
+#endif
+		"  -R      rule, e.g. B36/S23(default is taken from the pattern\n"
+		"          or checkpoint, B3/S23 if it is not given there)\n"
+		"  -H      jump generations ahead with Hashlife on root and report\n"
+		"          population and bounding box, arena size is ignored\n"
+		"  -m      print time workers spent calculating and communicating\n"
+		"  -M      also write time of each activity of each worker per\n"
+		"          generation into the file, Chrome trace JSON if its\n"
+		"          name ends with .json, otherwise CSV\n"
+		"  -b      move lines between rows of workers according to their\n"
+		"          calculation time once per b iterations(at frames only)\n"
+		"  -d      start with random soup of cells alive with given\n"
+		"          probability instead of pattern\n"
+		"  -S      seed of the soup(default %llu)\n"
+		"  -B      benchmark: show nothing, print workers, arena size,\n"
+		"          generations, time, cells per second, population\n"
+		"          and checksum of the arena when simulation ends\n",
+		name, WIDTH, HEIGHT, ITER_NUM, THREADS_NUM, (unsigned long long)SEED);
+}
+
+// Returns 0 on success
+int parse_args(int argc, char* argv[])
+{
+	int opt;
+	while ((opt = getopt(argc, argv, "w:h:i:f:n:g:t:Tok:r:c:p:l:s:R:H:mM:b:d:S:B")) != -1) {
+		switch (opt) {
+		case 'w':
+			if (read_int(optarg, &WIDTH))
+				return 1;
+			break;
+		case 'h':
+			if (read_int(optarg, &HEIGHT))
+				return 1;
+			break;
+		case 'i':
+			if (read_int(optarg, &ITER_NUM))
+				return 1;
+			break;
+		case 'f':
+			RLE_FILE_NAME = optarg;
+			break;
+		case 'n':
+			if (read_int(optarg, &WORKERS_NUM))
+				return 1;
+			break;
+		case 'g':
+			if ((sscanf(optarg, "%dx%d", &GRID[0], &GRID[1]) != 2) ||
+			    (GRID[0] <= 0) || (GRID[1] <= 0))
+				return 1;
+			break;
+		case 't':
+			if (read_int(optarg, &THREADS_NUM))
+				return 1;
+			break;
+		case 'T':
+			TORUS = 1;
+			break;
+		case 'o':
+			OVERLAP_EXCHANGE = 1;
+			break;
+		case 'k':
+			if (read_int(optarg, &HALO_DEPTH))
+				return 1;
+			break;
+		case 'r':
+			if (read_int(optarg, &ITERATIONS_PER_FRAME))
+				return 1;
+			break;
+#ifndef CHAR_ARENA
+		case 'c':
+			CHECKPOINT_FILE_NAME = optarg;
+			break;
+		case 'p':
+			if (read_int(optarg, &CHECKPOINT_PERIOD))
+				return 1;
+			break;
+		case 'l':
+			RESTART_FILE_NAME = optarg;
+			break;
+#endif
+		case 'R':
+			RULE_STRING = optarg;
+			break;
+		case 'H':
+			if (read_uint64(optarg, &HASHLIFE_GENERATIONS))
+				return 1;
+			if (HASHLIFE_GENERATIONS > HL_MAX_GENERATIONS) {
+				fprintf(stderr, "Hashlife does not jump more than %llu generations\n",
+				        (unsigned long long)HL_MAX_GENERATIONS);
+				return 1;
+			}
+			break;
+		case 'm':
+			PROFILE = 1;
+			break;
+		case 'M':
+			PROFILE = 1;
+			TRACE_FILE_NAME = optarg;
+			break;
+		case 'b':
+			if (read_int(optarg, &BALANCE_PERIOD))
+				return 1;
+			break;
+		case 'd':
+			DENSITY = strtod(optarg, NULL);
+			if ((DENSITY <= 0.0) || (DENSITY > 1.0))
+				return 1;
+			break;
+		case 'S':
+			if (read_uint64(optarg, &SEED))
+				return 1;
+			break;
+		case 'B':
+			BENCHMARK = 1;
+			break;
+#ifdef DRAW_WITH_SDL
+		case 's':
+			SDL_SCALE = strtof(optarg, NULL);
+			if (SDL_SCALE <= 0)
+				return 1;
+			break;
+#endif
+		default:
+			return 1;
+		}
+	}
+	return (optind != argc);
+}
+
+int main(int argc, char* argv[])
+{
+	signal(SIGABRT, &graceful_abort);
+
+	// Only the main thread of a worker makes MPI calls
+	int thread_level = MPI_THREAD_SINGLE;
+	MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &thread_level);
+
+	int rank = 0;
+
+	MPI_Comm_size(MPI_COMM_WORLD, &MPI_SIZE);
+	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+	if (parse_args(argc, argv) != 0) {
+		if (rank == 0)
+			print_usage(argv[0]);
+		MPI_Finalize();
+		return 1;
+	}
+
+	if ((THREADS_NUM > 1) && (thread_level < MPI_THREAD_FUNNELED)) {
+		if (rank == 0)
+			fprintf(stderr, "MPI library does not support threads\n");
+		MPI_Finalize();
+		return 1;
+	}
+
+	if (RESTART_FILE_NAME && (read_checkpoint_header() != 0)) {
+		MPI_Finalize();
+		return 1;
+	}
+
+	if (set_rule(rank) != 0) {
+		MPI_Finalize();
+		return 1;
+	}
+
+	if (HASHLIFE_GENERATIONS != 0) {
+		if (rank == 0)
+			hashlife_func();
+		MPI_Finalize();
+		return 0;
+	}
+
+	if (WORKERS_NUM == 0)
+		WORKERS_NUM = (GRID[0] != 0) ? GRID[0] * GRID[1] : MPI_SIZE - 1;
+	if (GRID[0] == 0) {
+		MPI_Dims_create(WORKERS_NUM, 2, GRID);
+		// Too narrow arena, fall back to horizontal strips
+		if (GRID[1] > ROW_UNITS) {
+			GRID[0] = WORKERS_NUM;
+			GRID[1] = 1;
+		}
+	}
+	if ((WORKERS_NUM > MPI_SIZE - 1) || (GRID[0] * GRID[1] != WORKERS_NUM) ||
+	    (GRID[0] > HEIGHT) || (GRID[1] > ROW_UNITS)) {
+		if (rank == 0)
+			fprintf(stderr, "Grid of workers(%dx%d) must not exceed MPI_SIZE-1(%d) "
+			                "processes, HEIGHT(%d) lines and %d units of %d cells "
+			                "in line\n",
+			                GRID[0], GRID[1], MPI_SIZE-1, HEIGHT,
+			                ROW_UNITS, CELLS_PER_UNIT);
+		MPI_Finalize();
+		return 1;
+	}
+
+#ifndef CHAR_ARENA
+	if (TORUS && (WIDTH % CELLS_PER_UNIT != 0)) {
+		if (rank == 0)
+			fprintf(stderr, "Width of torus(%d) must be multiple of %d\n",
+			                WIDTH, CELLS_PER_UNIT);
+		MPI_Finalize();
+		return 1;
+	}
+#endif
+
+	// Each neighbor has to own enough cells to fill the halo
+	int halo_units = (HALO_DEPTH + CELLS_PER_UNIT - 1) / CELLS_PER_UNIT;
+	if ((HEIGHT / GRID[0] < HALO_DEPTH) || (ROW_UNITS / GRID[1] < halo_units)) {
+		if (rank == 0)
+			fprintf(stderr, "Blocks of workers(%dx%d units) are too small "
+			                "for halo depth %d\n",
+			                HEIGHT / GRID[0], ROW_UNITS / GRID[1], HALO_DEPTH);
+		MPI_Finalize();
+		return 1;
+	}
+
+	LINE_BOUNDS = (int*)calloc(GRID[0] + 1, sizeof(int));
+	assert(LINE_BOUNDS);
+	for (int i = 0; i < GRID[0]; i++)
+		LINE_BOUNDS[i + 1] = split_range(HEIGHT, GRID[0], i).end;
+
+	MPI_Comm_split(MPI_COMM_WORLD, (rank <= WORKERS_NUM) ? 0 : MPI_UNDEFINED,
+	               rank, &LIFE_COMM);
+	if (LIFE_COMM == MPI_COMM_NULL) {
+		// Not needed for simulation
+		free(LINE_BOUNDS);
+		MPI_Finalize();
+		return 0;
+	}
+
+	MPI_Comm workers_comm;
+	MPI_Comm_split(LIFE_COMM, (rank == 0) ? MPI_UNDEFINED : 0, rank, &workers_comm);
+
+	if (rank == 0) {
+
+#ifdef DRAW_WITH_SDL
+		renderer_s renderer;
+		if (!BENCHMARK)
+			renderer_start(&renderer);
+		root_func(&renderer);
+		if (!BENCHMARK)
+			renderer_stop(&renderer);
+#else
+		root_func(NULL);
+#endif
+	} else {
+		worker_func(workers_comm, rank);
+		MPI_Comm_free(&workers_comm);
+	}
 
+	MPI_Comm_free(&LIFE_COMM);
+	free(LINE_BOUNDS);
 	MPI_Finalize();
 	return 0;
 }
@@ -0,0 +1,375 @@
+#include "pattern.h"
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Lines of header and macrocell are short
+#define LINE_LEN 1024
+
+typedef void (*set_cell_f)(void* ctx, int64_t line, int64_t col);
+
+static void skip_line(FILE* file)
+{
+	int c;
+	while (((c = getc(file)) != EOF) && (c != '\n'))
+		;
+}
+
+// Copies str without leading and trailing spaces
+static void copy_rule(char rule[PATTERN_RULE_LEN], const char* str)
+{
+	while (isspace((unsigned char)*str))
+		str++;
+	size_t len = strlen(str);
+	while ((len > 0) && isspace((unsigned char)str[len - 1]))
+		len--;
+	if (len >= PATTERN_RULE_LEN)
+		len = PATTERN_RULE_LEN - 1;
+	memcpy(rule, str, len);
+	rule[len] = '\0';
+}
+
+// Header is "x = m, y = n, rule = abc", rule is optional
+static int read_rle_header(FILE* file, pattern_info_s* info)
+{
+	char line[LINE_LEN];
+	if (!fgets(line, sizeof(line), file))
+		return 1;
+	for (char* field = strtok(line, ","); field; field = strtok(NULL, ",")) {
+		char* eq = strchr(field, '=');
+		if (!eq)
+			return 1;
+		*eq = '\0';
+		char key[16];
+		if (sscanf(field, " %15s", key) != 1)
+			return 1;
+		long long val;
+		if (!strcmp(key, "x") && (sscanf(eq + 1, "%lld", &val) == 1)) {
+			info->width = val;
+		} else if (!strcmp(key, "y") && (sscanf(eq + 1, "%lld", &val) == 1)) {
+			info->height = val;
+		} else if (!strcmp(key, "rule")) {
+			copy_rule(info->rule, eq + 1);
+		} else {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static int read_rle(FILE* file, pattern_info_s* info, set_cell_f set_cell, void* ctx)
+{
+	int c;
+	// Comments and header
+	while ((c = getc(file)) == '#')
+		skip_line(file);
+	if (c == 'x') {
+		ungetc(c, file);
+		if (read_rle_header(file, info)) {
+			fprintf(stderr, "Invalid RLE header\n");
+			return 1;
+		}
+	} else if (c != EOF) {
+		ungetc(c, file);
+	}
+
+	int64_t line = 0, col = 0;
+	int64_t cnt = 0;
+	while ((c = getc(file)) != EOF) {
+		if (isdigit(c)) {
+			cnt = cnt * 10 + (c - '0');
+			continue;
+		}
+		if (isspace(c))
+			continue;
+		if (c == '!')
+			break;
+		int64_t n = cnt ? cnt : 1;
+		cnt = 0;
+		if ((c == 'b') || (c == '.')) {
+			col += n;
+		} else if ((c == 'o') || ((c >= 'A') && (c <= 'X'))) {
+			// States of multistate rules are treated as alive
+			for (int64_t i = 0; i < n; i++)
+				set_cell(ctx, line, col++);
+		} else if (c == '$') {
+			col = 0;
+			line += n;
+		} else {
+			fprintf(stderr, "Unexpected '%c' in RLE\n", c);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Lines of '.'(dead) and 'O'(alive), lines starting with '!' are comments
+static int read_plaintext(FILE* file, set_cell_f set_cell, void* ctx)
+{
+	int64_t line = 0, col = 0;
+	int c;
+	while ((c = getc(file)) != EOF) {
+		if ((c == '!') && (col == 0)) {
+			skip_line(file);
+			continue;
+		}
+		if (c == '\n') {
+			line++;
+			col = 0;
+		} else if ((c == 'O') || (c == '*')) {
+			set_cell(ctx, line, col++);
+		} else if (c == '.') {
+			col++;
+		} else if (!isspace(c)) {
+			fprintf(stderr, "Unexpected '%c' in plaintext pattern\n", c);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+// Node of given level built from 8x8 cells of macrocell leaf
+static hl_node_s* leaf_node(hl_universe_s* u, unsigned char cells[8][8],
+                            int x, int y, int level)
+{
+	if (level == 0)
+		return hl_leaf(u, cells[y][x]);
+	int half = 1 << (level - 1);
+	return hl_node(u, leaf_node(u, cells, x,        y,        level - 1),
+	                  leaf_node(u, cells, x + half, y,        level - 1),
+	                  leaf_node(u, cells, x,        y + half, level - 1),
+	                  leaf_node(u, cells, x + half, y + half, level - 1));
+}
+
+// Nodes are numbered from 1 in the order they are listed, each line is
+// either 8x8 leaf of '.', '*' and '$' or "level nw ne sw se" where 0
+// stands for empty child(dead cell for level 1). The last node is root.
+static int read_macrocell(FILE* file, pattern_info_s* info, hl_universe_s* u)
+{
+	char line[LINE_LEN];
+	size_t nodes_num = 0, nodes_size = 1024;
+	hl_node_s** nodes = (hl_node_s**)calloc(nodes_size, sizeof(hl_node_s*));
+	assert(nodes);
+	int ret = 0;
+
+	// [M2] line
+	skip_line(file);
+	while (fgets(line, sizeof(line), file)) {
+		hl_node_s* node = NULL;
+		if (line[0] == '#') {
+			if (line[1] == 'R')
+				copy_rule(info->rule, line + 2);
+			continue;
+		}
+		if ((line[0] == '.') || (line[0] == '*') || (line[0] == '$')) {
+			unsigned char cells[8][8];
+			memset(cells, 0, sizeof(cells));
+			int x = 0, y = 0;
+			for (const char* c = line; (*c != '\0') && (*c != '\n'); c++) {
+				if (*c == '$') {
+					x = 0;
+					y++;
+				} else if ((x < 8) && (y < 8)) {
+					cells[y][x++] = (*c == '*');
+				}
+			}
+			node = leaf_node(u, cells, 0, 0, 3);
+		} else {
+			int level;
+			long long children[4];
+			if (sscanf(line, "%d %lld %lld %lld %lld", &level, &children[0],
+			           &children[1], &children[2], &children[3]) != 5) {
+				if (line[strspn(line, " \t\r\n")] == '\0')
+					continue;
+				fprintf(stderr, "Invalid macrocell line '%s'\n", line);
+				ret = 1;
+				break;
+			}
+			hl_node_s* quads[4];
+			for (int i = 0; i < 4; i++) {
+				if ((level < 1) || (level > HL_MAX_LEVEL) || (children[i] < 0) ||
+				    ((size_t)children[i] > nodes_num)) {
+					ret = 1;
+				} else if (level == 1) {
+					quads[i] = hl_leaf(u, children[i]);
+				} else if (children[i] == 0) {
+					quads[i] = hl_empty(u, level - 1);
+				} else {
+					quads[i] = nodes[children[i] - 1];
+					ret |= (quads[i]->level != level - 1);
+				}
+			}
+			if (ret) {
+				fprintf(stderr, "Invalid macrocell node '%s'\n", line);
+				break;
+			}
+			node = hl_node(u, quads[0], quads[1], quads[2], quads[3]);
+		}
+
+		if (nodes_num == nodes_size) {
+			nodes_size *= 2;
+			nodes = (hl_node_s**)realloc(nodes, nodes_size * sizeof(hl_node_s*));
+			assert(nodes);
+		}
+		nodes[nodes_num++] = node;
+	}
+
+	if (!ret && (nodes_num != 0)) {
+		u->root = nodes[nodes_num - 1];
+		// Move north-west corner of the pattern to (0, 0)
+		int64_t x0, y0, x1, y1;
+		u->x = u->y = 0;
+		if (hl_bounding_box(u, &x0, &y0, &x1, &y1)) {
+			u->x = -x0;
+			u->y = -y0;
+		}
+	}
+	free(nodes);
+	return ret;
+}
+
+// Digits of neighbor numbers, returns pointer past them
+static const char* parse_neighbors(const char* str, unsigned* mask)
+{
+	*mask = 0;
+	for (; (*str >= '0') && (*str <= '8'); str++)
+		*mask |= 1u << (*str - '0');
+	return str;
+}
+
+int pattern_parse_rule(const char* str, rule_s* rule)
+{
+	unsigned first, second;
+	char first_letter = (char)toupper((unsigned char)*str);
+	if ((first_letter == 'B') || (first_letter == 'S'))
+		str++;
+	str = parse_neighbors(str, &first);
+	if (*str++ != '/')
+		return 1;
+	char second_letter = (char)toupper((unsigned char)*str);
+	if ((second_letter == 'B') || (second_letter == 'S'))
+		str++;
+	str = parse_neighbors(str, &second);
+	if (*str != '\0')
+		return 1;
+
+	if ((first_letter == 'B') && ((second_letter == 'S') || (second_letter == '\0'))) {
+		rule->birth = first;
+		rule->survival = second;
+	} else if ((first_letter == 'S') && (second_letter == 'B')) {
+		rule->survival = first;
+		rule->birth = second;
+	} else if (isdigit((unsigned char)first_letter) || (first_letter == '/')) {
+		// Old notation without letters is survival/birth
+		rule->survival = first;
+		rule->birth = second;
+	} else {
+		return 1;
+	}
+	return 0;
+}
+
+int pattern_read_info(const char* file_name, pattern_info_s* info)
+{
+	memset(info, 0, sizeof(*info));
+	FILE* file = fopen(file_name, "rb");
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", file_name);
+		return 1;
+	}
+
+	int ret = 0;
+	int c = getc(file);
+	if (c == '[') {
+		// Rule is given in comments following [M2] line
+		char line[LINE_LEN];
+		skip_line(file);
+		while (fgets(line, sizeof(line), file) && (line[0] == '#'))
+			if (line[1] == 'R')
+				copy_rule(info->rule, line + 2);
+	} else if ((c == '#') || (c == 'x')) {
+		while (c == '#') {
+			skip_line(file);
+			c = getc(file);
+		}
+		if (c == 'x') {
+			ungetc(c, file);
+			ret = read_rle_header(file, info);
+			if (ret)
+				fprintf(stderr, "Invalid RLE header\n");
+		}
+	}
+	fclose(file);
+	return ret;
+}
+
+struct cell_adapter {
+	set_cell_f set_cell;
+	void* ctx;
+};
+
+static void set_universe_cell(void* u, int64_t line, int64_t col)
+{
+	hl_set_cell((hl_universe_s*)u, col, line);
+}
+
+static void adapt_cell(void* adapter, int64_t x, int64_t y)
+{
+	struct cell_adapter* a = (struct cell_adapter*)adapter;
+	a->set_cell(a->ctx, y, x);
+}
+
+// Either set_cell or u is used
+static int read_file(const char* file_name, pattern_info_s* info,
+                     set_cell_f set_cell, void* ctx, hl_universe_s* u)
+{
+	memset(info, 0, sizeof(*info));
+	FILE* file = fopen(file_name, "rb");
+	if (!file) {
+		fprintf(stderr, "Failed to open %s\n", file_name);
+		return 1;
+	}
+	if (u) {
+		set_cell = &set_universe_cell;
+		ctx = u;
+	}
+
+	int ret;
+	int c = getc(file);
+	ungetc(c, file);
+	if (c == '[') {
+		if (u) {
+			ret = read_macrocell(file, info, u);
+		} else {
+			// Quadtree is expanded line after line
+			hl_universe_s tmp;
+			hl_init(&tmp, SIZE_MAX);
+			ret = read_macrocell(file, info, &tmp);
+			struct cell_adapter adapter = {set_cell, ctx};
+			if (!ret)
+				hl_for_each_cell(&tmp, &adapt_cell, &adapter);
+			hl_destroy(&tmp);
+		}
+	} else if ((c == '!') || (c == '.') || (c == 'O') || (c == '*')) {
+		ret = read_plaintext(file, set_cell, ctx);
+	} else {
+		ret = read_rle(file, info, set_cell, ctx);
+	}
+	fclose(file);
+	return ret;
+}
+
+int pattern_read(const char* file_name, pattern_info_s* info,
+                 void (*set_cell)(void* ctx, int64_t line, int64_t col), void* ctx)
+{
+	return read_file(file_name, info, set_cell, ctx, NULL);
+}
+
+int pattern_read_universe(const char* file_name, pattern_info_s* info,
+                          hl_universe_s* u)
+{
+	return read_file(file_name, info, NULL, NULL, u);
+}
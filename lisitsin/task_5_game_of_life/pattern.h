@@ -0,0 +1,45 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+// Readers of Life patterns in RLE(with or without "x = , y = , rule ="
+// header), plaintext(.cells) and macrocell formats. Format is guessed
+// from the first character of the file. Cells are reported line after
+// line as they are decoded, with north-west corner of the pattern at
+// (0, 0), so patterns of any size are streamed without being stored.
+
+#include <stdint.h>
+
+#include "hashlife.h"
+
+#define PATTERN_RULE_LEN 64
+
+typedef struct {
+	// Size from RLE header, 0 if it is not given
+	int64_t width, height;
+	// Rule from RLE header or macrocell #R line, empty if it is not given
+	char rule[PATTERN_RULE_LEN];
+} pattern_info_s;
+
+// Outer-totalistic rule, bit n of birth(survival) is set if dead(alive)
+// cell with n alive neighbors is alive at the next generation
+typedef struct {
+	unsigned birth, survival;
+} rule_s;
+
+// Parses rule in B/S("B36/S23") or S/B("23/36") notation.
+// Returns 0 on success.
+int pattern_parse_rule(const char* str, rule_s* rule);
+
+// Reads size and rule only. Returns 0 on success.
+int pattern_read_info(const char* file_name, pattern_info_s* info);
+
+// Returns 0 on success
+int pattern_read(const char* file_name, pattern_info_s* info,
+                 void (*set_cell)(void* ctx, int64_t line, int64_t col), void* ctx);
+
+// Same for Hashlife universe. Macrocell pattern is loaded
+// as a quadtree, without being expanded into cells.
+int pattern_read_universe(const char* file_name, pattern_info_s* info,
+                          hl_universe_s* u);
+
+#endif
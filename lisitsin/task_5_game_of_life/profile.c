@@ -0,0 +1,247 @@
+#include "profile.h"
+
+#include <assert.h>
+#include <float.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	uint64_t generation;
+	// Seconds since prof_start
+	double begin, end;
+	int kind;
+} interval_s;
+
+static const char* const KIND_NAMES[PROF_KINDS_NUM] = {
+	[PROF_COMPUTE]    = "compute",
+	[PROF_HALO]       = "halo",
+	[PROF_HALO_WAIT]  = "halo_wait",
+	[PROF_SEND]       = "send",
+	[PROF_ROOT_WAIT]  = "root_wait",
+	[PROF_CHECKPOINT] = "checkpoint",
+	[PROF_BALANCE]    = "balance",
+};
+
+static struct {
+	MPI_Comm comm;
+	int active;
+	double origin;
+	// Current interval
+	int kind;
+	double begin;
+	uint64_t generation;
+	double totals[PROF_KINDS_NUM];
+	int keep_trace;
+	interval_s* intervals;
+	size_t intervals_num, intervals_size;
+} PROF = {MPI_COMM_NULL};
+
+static double now(void)
+{
+	return MPI_Wtime() - PROF.origin;
+}
+
+void prof_start(MPI_Comm comm, int keep_trace)
+{
+	PROF.comm = comm;
+	PROF.keep_trace = keep_trace;
+	PROF.intervals_num = 0;
+	memset(PROF.totals, 0, sizeof(PROF.totals));
+	// Clocks are not synchronized, so intervals of
+	// all processes are counted from the barrier
+	MPI_Barrier(comm);
+	PROF.origin = MPI_Wtime();
+	int rank;
+	MPI_Comm_rank(comm, &rank);
+	PROF.active = (rank != 0);
+	PROF.kind = PROF_COMPUTE;
+	PROF.begin = 0.0;
+	PROF.generation = 0;
+}
+
+// Ends current interval at given time
+static void end_interval(double end)
+{
+	PROF.totals[PROF.kind] += end - PROF.begin;
+	if (PROF.keep_trace && (end > PROF.begin)) {
+		if (PROF.intervals_num == PROF.intervals_size) {
+			PROF.intervals_size = PROF.intervals_size ? 2 * PROF.intervals_size : 1024;
+			PROF.intervals = (interval_s*)realloc(PROF.intervals,
+			                     PROF.intervals_size * sizeof(interval_s));
+			assert(PROF.intervals);
+		}
+		interval_s* interval = &PROF.intervals[PROF.intervals_num++];
+		interval->generation = PROF.generation;
+		interval->begin = PROF.begin;
+		interval->end = end;
+		interval->kind = PROF.kind;
+	}
+	PROF.begin = end;
+}
+
+void prof_switch(int kind)
+{
+	if (!PROF.active || (kind == PROF.kind))
+		return;
+	end_interval(now());
+	PROF.kind = kind;
+}
+
+void prof_generation(uint64_t generation)
+{
+	if (!PROF.active)
+		return;
+	end_interval(now());
+	PROF.generation = generation;
+}
+
+void prof_stop(void)
+{
+	if (!PROF.active)
+		return;
+	end_interval(now());
+	PROF.active = 0;
+}
+
+static void print_table(FILE* out, const double* min, const double* sum,
+                        const double* max, int workers_num)
+{
+	fprintf(out, "\n%-12s %12s %12s %12s %9s\n",
+	        "time, s", "min", "avg", "max", "max/avg");
+	for (int kind = 0; kind <= PROF_KINDS_NUM; kind++) {
+		double avg = sum[kind] / workers_num;
+		fprintf(out, "%-12s %12.6f %12.6f %12.6f %9.3f\n",
+		        (kind == PROF_KINDS_NUM) ? "total" : KIND_NAMES[kind],
+		        min[kind], avg, max[kind], (avg > 0) ? max[kind] / avg : 1.0);
+	}
+}
+
+// Time of each activity per generation, intervals of a worker
+// go in order of time, so generations do not interleave
+static void write_csv(FILE* file, const interval_s* intervals, const int* counts,
+                      const int* displs, int size)
+{
+	fprintf(file, "rank,generation");
+	for (int kind = 0; kind < PROF_KINDS_NUM; kind++)
+		fprintf(file, ",%s", KIND_NAMES[kind]);
+	fprintf(file, "\n");
+	for (int rank = 1; rank < size; rank++) {
+		const interval_s* first = &intervals[displs[rank]];
+		const interval_s* last = first + counts[rank];
+		while (first != last) {
+			uint64_t generation = first->generation;
+			double times[PROF_KINDS_NUM] = {0};
+			for (; (first != last) && (first->generation == generation); first++)
+				times[first->kind] += first->end - first->begin;
+			fprintf(file, "%d,%llu", rank, (unsigned long long)generation);
+			for (int kind = 0; kind < PROF_KINDS_NUM; kind++)
+				fprintf(file, ",%.9f", times[kind]);
+			fprintf(file, "\n");
+		}
+	}
+}
+
+// Each worker is a thread of the only process, times are in microseconds
+static void write_chrome_trace(FILE* file, const interval_s* intervals,
+                               const int* counts, const int* displs, int size)
+{
+	fprintf(file, "{\"traceEvents\":[\n");
+	const char* separator = "";
+	for (int rank = 1; rank < size; rank++) {
+		fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,"
+		              "\"args\":{\"name\":\"worker %d\"}}",
+		        separator, rank, rank);
+		separator = ",\n";
+		for (int i = displs[rank]; i < displs[rank] + counts[rank]; i++)
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,"
+			              "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"generation\":%llu}}",
+			        KIND_NAMES[intervals[i].kind], rank, intervals[i].begin * 1e6,
+			        (intervals[i].end - intervals[i].begin) * 1e6,
+			        (unsigned long long)intervals[i].generation);
+	}
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+static void write_trace(const char* trace_file)
+{
+	int rank, size;
+	MPI_Comm_rank(PROF.comm, &rank);
+	MPI_Comm_size(PROF.comm, &size);
+
+	// Intervals are gathered as bytes, all processes run the same binary
+	int bytes = (int)(PROF.intervals_num * sizeof(interval_s));
+	int* counts = NULL;
+	int* displs = NULL;
+	interval_s* intervals = NULL;
+	if (rank == 0) {
+		counts = (int*)calloc(size, sizeof(int));
+		assert(counts);
+		displs = (int*)calloc(size, sizeof(int));
+		assert(displs);
+	}
+	MPI_Gather(&bytes, 1, MPI_INT, counts, 1, MPI_INT, 0, PROF.comm);
+	if (rank == 0) {
+		for (int i = 1; i < size; i++)
+			displs[i] = displs[i - 1] + counts[i - 1];
+		intervals = (interval_s*)malloc(displs[size - 1] + counts[size - 1] + 1);
+		assert(intervals);
+	}
+	MPI_Gatherv(PROF.intervals, bytes, MPI_BYTE,
+	            intervals, counts, displs, MPI_BYTE, 0, PROF.comm);
+	if (rank != 0)
+		return;
+
+	// Counts of intervals from now on
+	for (int i = 0; i < size; i++) {
+		counts[i] /= sizeof(interval_s);
+		displs[i] /= sizeof(interval_s);
+	}
+	FILE* file = fopen(trace_file, "w");
+	if (file) {
+		size_t len = strlen(trace_file);
+		if ((len >= 5) && !strcmp(trace_file + len - 5, ".json"))
+			write_chrome_trace(file, intervals, counts, displs, size);
+		else
+			write_csv(file, intervals, counts, displs, size);
+		fclose(file);
+	} else {
+		fprintf(stderr, "Failed to open %s\n", trace_file);
+	}
+	free(intervals);
+	free(displs);
+	free(counts);
+}
+
+void prof_report(FILE* out, const char* trace_file)
+{
+	int rank, size;
+	MPI_Comm_rank(PROF.comm, &rank);
+	MPI_Comm_size(PROF.comm, &size);
+
+	// Root contributes neutral values
+	double local_min[PROF_KINDS_NUM + 1], local_max[PROF_KINDS_NUM + 1];
+	double local_sum[PROF_KINDS_NUM + 1];
+	double total = 0.0;
+	for (int kind = 0; kind < PROF_KINDS_NUM; kind++) {
+		local_sum[kind] = PROF.totals[kind];
+		total += PROF.totals[kind];
+	}
+	local_sum[PROF_KINDS_NUM] = total;
+	for (int kind = 0; kind <= PROF_KINDS_NUM; kind++) {
+		local_min[kind] = (rank == 0) ? DBL_MAX : local_sum[kind];
+		local_max[kind] = local_sum[kind];
+	}
+	double min[PROF_KINDS_NUM + 1], max[PROF_KINDS_NUM + 1], sum[PROF_KINDS_NUM + 1];
+	MPI_Reduce(local_min, min, PROF_KINDS_NUM + 1, MPI_DOUBLE, MPI_MIN, 0, PROF.comm);
+	MPI_Reduce(local_max, max, PROF_KINDS_NUM + 1, MPI_DOUBLE, MPI_MAX, 0, PROF.comm);
+	MPI_Reduce(local_sum, sum, PROF_KINDS_NUM + 1, MPI_DOUBLE, MPI_SUM, 0, PROF.comm);
+	if ((rank == 0) && (size > 1))
+		print_table(out, min, sum, max, size - 1);
+
+	if (trace_file)
+		write_trace(trace_file);
+
+	free(PROF.intervals);
+	PROF.intervals = NULL;
+	PROF.intervals_num = PROF.intervals_size = 0;
+}
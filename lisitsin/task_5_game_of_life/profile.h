@@ -0,0 +1,52 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// Timers of workers. Wall time of each worker is split into intervals
+// of the activities below: prof_switch() ends the current interval and
+// starts one of another activity, so every moment is accounted for
+// exactly once and nested calls need no stack. Totals of all workers
+// are reduced to root into a min/avg/max table, and optionally every
+// interval is gathered and written as a trace.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <mpi.h>
+
+enum {
+	// Calculating cells, including waits at barriers of the pool
+	PROF_COMPUTE = 0,
+	// Posting halo messages and marking changed halo tiles
+	PROF_HALO,
+	// Waiting for halo of neighbors
+	PROF_HALO_WAIT,
+	// Copying frame and posting its gather
+	PROF_SEND,
+	// Waiting for previous frame to be gathered and root's command
+	PROF_ROOT_WAIT,
+	PROF_CHECKPOINT,
+	// Moving lines between workers
+	PROF_BALANCE,
+	PROF_KINDS_NUM,
+};
+
+// Starts timers of all processes of comm, root of which(rank 0)
+// does not take part in simulation. Collective.
+// Intervals are kept for the trace if keep_trace is set.
+void prof_start(MPI_Comm comm, int keep_trace);
+
+// Current interval ends, next one is of given kind
+void prof_switch(int kind);
+
+// Following intervals belong to given generation
+void prof_generation(uint64_t generation);
+
+// Ends the last interval
+void prof_stop(void);
+
+// Root prints table of totals into out and writes trace into
+// trace_file(if not NULL): Chrome trace JSON if its name ends
+// with ".json", otherwise CSV with time of each activity per
+// worker and generation. Collective.
+void prof_report(FILE* out, const char* trace_file);
+
+#endif